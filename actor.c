@@ -0,0 +1,274 @@
+//
+//  actor.c
+//  Labyrinth
+//
+//  Actors: everything that moves around the map besides the player. The
+//  pool is stored as parallel arrays, one per field, so the per-tick update
+//  streams through memory. Each dimension has a uniform grid with one cell
+//  per tile, and every actor is linked into the cell its center is in. An
+//  actor is only relinked when it changes tile, and collision and sprite
+//  queries only look at the cells around them.
+//
+
+#include <math.h>
+
+#include "labyrinth.h"
+
+actors_t	actors;
+int			*actorcells;	// first actor in each cell, -1 if none
+int			numcells;
+int			numactors;		// spawned when a level starts (-actors)
+float		actorfrac;		// how far between ticks to draw actors
+uint32_t	actorseed = 1;
+
+
+
+
+//
+// ActorRandom
+// Random number in 0..1, repeatable from run to run
+//
+float ActorRandom (void)
+{
+	actorseed = actorseed * 1664525 + 1013904223;
+	return (actorseed >> 8) / 16777216.0f;
+}
+
+
+
+
+int ActorCell (int w, float x, float y)
+{
+	return (w * map.height + (int)y) * map.width + (int)x;
+}
+
+
+
+
+void LinkActor (int i)
+{
+	int cell = ActorCell(actors.w[i], actors.x[i], actors.y[i]);
+	
+	actors.cell[i] = cell;
+	actors.prev[i] = -1;
+	actors.next[i] = actorcells[cell];
+	if (actorcells[cell] != -1)
+		actors.prev[actorcells[cell]] = i;
+	actorcells[cell] = i;
+}
+
+
+
+
+void UnlinkActor (int i)
+{
+	if (actors.prev[i] != -1)
+		actors.next[actors.prev[i]] = actors.next[i];
+	else
+		actorcells[actors.cell[i]] = actors.next[i];
+	if (actors.next[i] != -1)
+		actors.prev[actors.next[i]] = actors.prev[i];
+}
+
+
+
+
+//
+// ClearActors
+// Remove every actor and size the grid for the current map. Call before
+// spawning actors in a newly loaded or edited map.
+//
+void ClearActors (void)
+{
+	int i;
+	
+	actors.count = 0;
+	free(actorcells);
+	numcells = map.numdims * map.width * map.height;
+	actorcells = malloc(numcells * sizeof(int));
+	if (!actorcells)
+		Quit("ClearActors: Out of memory");
+	for (i=0 ; i<numcells ; i++)
+		actorcells[i] = -1;
+}
+
+
+
+
+//
+// GrowActors
+// Make room for at least 'count' actors
+//
+void GrowActors (int count)
+{
+	int capacity;
+	
+	if (count <= actors.capacity)
+		return;
+	capacity = actors.capacity ? actors.capacity : 256;
+	while (capacity < count)
+		capacity *= 2;
+
+#define GROW(field)	actors.field = realloc(actors.field, capacity * sizeof(*actors.field))
+	GROW(x);
+	GROW(y);
+	GROW(oldx);
+	GROW(oldy);
+	GROW(dx);
+	GROW(dy);
+	GROW(r);
+	GROW(w);
+	GROW(cell);
+	GROW(next);
+	GROW(prev);
+#undef GROW
+	if (!actors.x || !actors.y || !actors.oldx || !actors.oldy || !actors.dx
+		|| !actors.dy || !actors.r || !actors.w || !actors.cell || !actors.next
+		|| !actors.prev)
+		Quit("GrowActors: Out of memory");
+	actors.capacity = capacity;
+}
+
+
+
+
+//
+// SweepActors
+// Sweep a circle of radius r in dimension w against the actors (other than
+// 'ignore') it could reach, for SlideMove
+//
+void SweepActors (int w, float x, float y, float r, float xmove, float ymove,
+				  int ignore, contact_t *contact)
+{
+	int		cx, cy, x1, y1, x2, y2;
+	int		i;
+	float	reach;
+	
+	if (!actors.count)
+		return;
+	
+	// cells are one tile: any actor that could touch is within AC_RADIUS
+	// of the swept circle's box
+	reach = r + AC_RADIUS;
+	x1 = (int)(fminf(x, x + xmove) - reach);
+	y1 = (int)(fminf(y, y + ymove) - reach);
+	x2 = (int)(fmaxf(x, x + xmove) + reach);
+	y2 = (int)(fmaxf(y, y + ymove) + reach);
+	bound(x1, 0, map.width - 1);
+	bound(y1, 0, map.height - 1);
+	bound(x2, 0, map.width - 1);
+	bound(y2, 0, map.height - 1);
+	
+	for (cy=y1 ; cy<=y2 ; cy++)
+		for (cx=x1 ; cx<=x2 ; cx++)
+			for (i=actorcells[ActorCell(w, cx, cy)] ; i!=-1 ; i=actors.next[i])
+				if (i != ignore)
+					SweepCircle(x, y, xmove, ymove, actors.x[i], actors.y[i],
+								r + actors.r[i], contact);
+}
+
+
+
+
+//
+// SpawnActor
+// Add an actor at x, y heading in direction 'angle'. Returns its index.
+//
+int SpawnActor (int w, float x, float y, float angle)
+{
+	int i;
+	
+	GrowActors(actors.count + 1);
+	i = actors.count++;
+	actors.x[i] = actors.oldx[i] = x;
+	actors.y[i] = actors.oldy[i] = y;
+	actors.dx[i] = AC_SPEED * sinf(angle);
+	actors.dy[i] = AC_SPEED * cosf(angle);
+	actors.r[i] = AC_RADIUS;
+	actors.w[i] = w;
+	LinkActor(i);
+	
+	return i;
+}
+
+
+
+
+//
+// SpawnActors
+// Scatter 'count' actors over the open tiles of the map, at most one per
+// tile, away from the player
+//
+void SpawnActors (int count)
+{
+	int	*open;
+	int	numopen, w, x, y, i, tile;
+	
+	open = malloc(map.numdims * map.width * map.height * sizeof(int));
+	if (!open)
+		Quit("SpawnActors: Out of memory");
+	numopen = 0;
+	for (w=0 ; w<map.numdims ; w++)
+		for (y=0 ; y<map.height ; y++)
+			for (x=0 ; x<map.width ; x++)
+			{
+				if (MapType(w, x, y) != TT_EMPTY || actorcells[ActorCell(w, x, y)] != -1)
+					continue;
+				if (w == player.w && abs(x - (int)player.x) < 2 && abs(y - (int)player.y) < 2)
+					continue;
+				open[numopen++] = (w * map.height + y) * map.width + x;
+			}
+	
+	// draw tiles from the list, taking each one out as it is used
+	for ( ; count > 0 && numopen > 0 ; count--)
+	{
+		i = (int)(ActorRandom() * numopen) % numopen;
+		tile = open[i];
+		open[i] = open[--numopen];
+		x = tile % map.width;
+		y = tile / map.width % map.height;
+		w = tile / map.width / map.height;
+		SpawnActor(w, x + 0.5f, y + 0.5f, ActorRandom() * ANGLES);
+	}
+	free(open);
+	if (count)
+		printf("SpawnActors: No room for %d actors\n", count);
+}
+
+
+
+
+//
+// MoveActors
+// Move every actor one tick. Actors slide along whatever blocks them and
+// pick a new direction when they can't make much headway.
+//
+void MoveActors (void)
+{
+	int		i;
+	float	angle, xmove, ymove, moved;
+	
+	for (i=0 ; i<actors.count ; i++)
+	{
+		actors.oldx[i] = actors.x[i];
+		actors.oldy[i] = actors.y[i];
+		SlideMove(&actors.w[i], &actors.x[i], &actors.y[i], actors.r[i],
+				  actors.dx[i], actors.dy[i], i);
+		
+		// mostly blocked: turn somewhere else
+		xmove = actors.x[i] - actors.oldx[i];
+		ymove = actors.y[i] - actors.oldy[i];
+		moved = xmove * actors.dx[i] + ymove * actors.dy[i];
+		if (moved < AC_SPEED * AC_SPEED * 0.5f)
+		{
+			angle = ActorRandom() * ANGLES;
+			actors.dx[i] = AC_SPEED * sinf(angle);
+			actors.dy[i] = AC_SPEED * cosf(angle);
+		}
+		
+		if (ActorCell(actors.w[i], actors.x[i], actors.y[i]) != actors.cell[i]) {
+			UnlinkActor(i);
+			LinkActor(i);
+		}
+	}
+}
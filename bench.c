@@ -0,0 +1,276 @@
+//
+//  bench.c
+//  Labyrinth
+//
+//  Headless renderer benchmark (-bench): renders a fixed camera path
+//  through a level into the framebuffer, without a window or presenting,
+//  and reports frame timings and ray statistics.
+//
+
+#include <math.h>
+
+#include "labyrinth.h"
+
+#define BENCH_FRAMES		1000
+#define BENCH_WARMUP		10
+#define GOLDEN_ANGLE		2.39996323f
+#define TURN_FRAMES			64			// frames spent turning at each spot
+#define TURN_SPEED			0.02f		// radians per frame while turning
+
+// an actor as spawned, to start each run from the same place
+typedef struct
+{
+	float	x, y;
+	float	dx, dy;
+	int		w;
+} benchactor_t;
+
+bool			benchturn;	// turn in place instead of jumping around
+benchactor_t	*benchactors;
+int				numbenchactors;
+uint32_t		benchseed;	// actorseed when they were saved
+
+
+
+
+int CompareFloats (const void *a, const void *b)
+{
+	float fa = *(const float *)a;
+	float fb = *(const float *)b;
+	
+	return (fa > fb) - (fa < fb);
+}
+
+
+
+
+//
+// BenchCamera
+// Place the player for frame number 'frame' of the camera path: a fixed
+// pseudo-random walk over every open tile in every dimension, turning by
+// the golden angle each frame so all view directions are covered. With
+// benchturn, the camera instead stays at each tile for TURN_FRAMES frames
+// and turns there, as for the ray cache.
+//
+void BenchCamera (int frame, int *open, int numopen)
+{
+	uint32_t	seed;
+	int			tile;
+	
+	if (benchturn) {
+		SetAngle(&player, fmodf(frame * TURN_SPEED, ANGLES));
+		frame /= TURN_FRAMES;
+	}
+	seed = (frame + 1) * 2654435761u;
+	tile = open[(seed >> 8) % numopen];
+	
+	player.w = tile / (map.width * map.height);
+	player.x = tile % map.width + 0.5f;
+	player.y = tile / map.width % map.height + 0.5f;
+	if (!benchturn)
+		SetAngle(&player, fmodf(frame * GOLDEN_ANGLE, ANGLES));
+}
+
+
+
+
+//
+// SaveActors
+// Remember where the actors start, and the random numbers they will use
+//
+void SaveActors (void)
+{
+	int i;
+	
+	benchseed = actorseed;
+	numbenchactors = actors.count;
+	benchactors = malloc((numbenchactors + 1) * sizeof(benchactor_t));
+	if (!benchactors)
+		Quit("SaveActors: Out of memory");
+	for (i=0 ; i<numbenchactors ; i++)
+	{
+		benchactors[i].x = actors.x[i];
+		benchactors[i].y = actors.y[i];
+		benchactors[i].dx = actors.dx[i];
+		benchactors[i].dy = actors.dy[i];
+		benchactors[i].w = actors.w[i];
+	}
+}
+
+
+
+
+//
+// RestoreActors
+// Put the actors back where they started, heading the same way, so they
+// move the same way again
+//
+void RestoreActors (void)
+{
+	int i, actor;
+	
+	actorseed = benchseed;
+	ClearActors();
+	for (i=0 ; i<numbenchactors ; i++)
+	{
+		actor = SpawnActor(benchactors[i].w, benchactors[i].x, benchactors[i].y, 0);
+		actors.dx[actor] = benchactors[i].dx;
+		actors.dy[actor] = benchactors[i].dy;
+	}
+}
+
+
+
+
+//
+// BenchRun
+// Render the camera path once, storing each frame's time in ms in times[]
+// (sorted on return) and the ray counts in *rays, *tiles. The actors
+// start where they did on the first run, so every run draws the same
+// frames.
+//
+void BenchRun (int *open, int numopen, int numframes, float *times,
+			   long long *rays, long long *tiles)
+{
+	int			i;
+	uint64_t	start;
+	
+	RestoreActors();
+	for (i=0 ; i<BENCH_WARMUP ; i++) {
+		BenchCamera(i, open, numopen);
+		RenderView(&player);
+	}
+	
+	*rays = *tiles = 0;
+	for (i=0 ; i<numframes ; i++)
+	{
+		BenchCamera(i, open, numopen);
+		MoveActors();
+		start = SDL_GetPerformanceCounter();
+		RenderView(&player);
+		times[i] = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+		*rays += raycount;
+		*tiles += tilecount;
+		PROFILE_FRAME();
+	}
+	
+	qsort(times, numframes, sizeof(float), CompareFloats);
+}
+
+
+
+
+void BenchPrint (const char *label, int numframes, float *times,
+				 long long rays, long long tiles)
+{
+	int		i;
+	float	total;
+	
+	total = 0;
+	for (i=0 ; i<numframes ; i++)
+		total += times[i];
+	
+	printf("%s: ms min %.3f median %.3f p99 %.3f max %.3f mean %.3f\n", label,
+		   times[0], times[numframes / 2], times[(int)(0.99f * (numframes - 1))],
+		   times[numframes - 1], total / numframes);
+	printf("%s: rays %lld (%.1f/frame) tiles %lld (%.2f/ray)\n", label,
+		   rays, (double)rays / numframes, tiles, rays ? (double)tiles / rays : 0.0);
+}
+
+
+
+
+//
+// Benchmark
+// Render 'numframes' frames (0 for the default) of map number 'mapnum'
+// and print the results. If empty-space skipping or the packet caster is
+// on, the path is run again without it to report the difference. With the
+// ray cache, a path that turns in place is run with and without it.
+//
+void Benchmark (int mapnum, int numframes)
+{
+	char		name[80];
+	int			*open, numopen;
+	int			w, x, y;
+	int			lanes;
+	float		*times, *plaintimes;
+	long long	rays, tiles, plainrays, plaintiles;
+	
+	if (numframes < 1)
+		numframes = BENCH_FRAMES;
+	
+	sprintf(name, "map%02d.lab", mapnum);
+	if (!FileExists(name)) {
+		printf("Benchmark: %s not found\n", name);
+		Quit(NULL);
+	}
+	OpenMap(mapnum);
+	ClearActors();
+	SpawnActors(numactors);
+	SaveActors();
+	
+	// collect camera positions
+	open = malloc(map.numdims * map.width * map.height * sizeof(int));
+	times = malloc(numframes * sizeof(float));
+	plaintimes = malloc(numframes * sizeof(float));
+	if (!open || !times || !plaintimes)
+		Quit("Benchmark: Out of memory");
+	numopen = 0;
+	for (w=0 ; w<map.numdims ; w++)
+		for (y=0 ; y<map.height ; y++)
+			for (x=0 ; x<map.width ; x++)
+				if (MapType(w, x, y) == TT_EMPTY || MapType(w, x, y) == TT_PLAYERSTART)
+					open[numopen++] = (w * map.height + y) * map.width + x;
+	if (!numopen) {
+		printf("Benchmark: %s has no open tiles\n", name);
+		Quit(NULL);
+	}
+	
+	printf("bench: %s %dx%dx%d\n", name, map.width, map.height, map.numdims);
+	printf("bench: %dx%d threads %d frames %d depth %g caster %s actors %d\n", winw, winh,
+		   numthreads, numframes, viewdepth, packetname, actors.count);
+	
+	BenchRun(open, numopen, numframes, times, &rays, &tiles);
+	BenchPrint("bench", numframes, times, rays, tiles);
+	
+	if (emptyskip)
+	{
+		emptyskip = false;
+		BenchRun(open, numopen, numframes, plaintimes, &plainrays, &plaintiles);
+		emptyskip = true;
+		BenchPrint("bench -noskip", numframes, plaintimes, plainrays, plaintiles);
+		printf("bench: empty-space skipping visits %.2fx fewer tiles, median frame %.2fx faster\n",
+			   tiles ? (double)plaintiles / tiles : 0.0,
+			   times[numframes / 2] > 0 ? plaintimes[numframes / 2] / times[numframes / 2] : 0.0);
+	}
+	
+	if (packetlanes)
+	{
+		lanes = packetlanes;
+		packetlanes = 0;
+		BenchRun(open, numopen, numframes, plaintimes, &plainrays, &plaintiles);
+		packetlanes = lanes;
+		BenchPrint("bench -nosimd", numframes, plaintimes, plainrays, plaintiles);
+		printf("bench: %s packets, median frame %.2fx faster\n", packetname,
+			   times[numframes / 2] > 0 ? plaintimes[numframes / 2] / times[numframes / 2] : 0.0);
+	}
+	
+	if (raycache)
+	{
+		benchturn = true;
+		BenchRun(open, numopen, numframes, times, &rays, &tiles);
+		BenchPrint("bench turning", numframes, times, rays, tiles);
+		raycache = false;
+		BenchRun(open, numopen, numframes, plaintimes, &plainrays, &plaintiles);
+		raycache = true;
+		benchturn = false;
+		BenchPrint("bench turning uncached", numframes, plaintimes, plainrays, plaintiles);
+		printf("bench: ray cache casts %.2fx fewer rays turning in place, median frame %.2fx faster\n",
+			   rays ? (double)plainrays / rays : 0.0,
+			   times[numframes / 2] > 0 ? plaintimes[numframes / 2] / times[numframes / 2] : 0.0);
+	}
+	
+	free(open);
+	free(times);
+	free(plaintimes);
+}
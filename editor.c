@@ -58,6 +58,11 @@ int csry;
 int dim;
 int selected;
 
+// each dimension drawn once at TILESIZE pixels per tile, then kept up to
+// date one tile at a time by SetTile
+SDL_Texture *maptextures[MAXDIMS];
+bool texturesvalid;
+
 bool FileExists (const char *name)
 {
     struct stat buffer;
@@ -74,11 +79,17 @@ bool Shift ()
     return keys[SDL_SCANCODE_LSHIFT] || keys[SDL_SCANCODE_RSHIFT];
 }
 
+// window point x, y to the map tile under it
+void WindowTile (int *x, int *y)
+{
+    *x = (*x / winscale + originx) / TILESIZE;
+    *y = (*y / winscale + originy) / TILESIZE;
+}
+
 void GetMouseTile (int *x, int *y)
 {
     SDL_GetMouseState(x, y);
-    *x = (*x / SCALE + originx) / TILESIZE;
-    *y = (*y / SCALE + originy) / TILESIZE;
+    WindowTile(x, y);
 }
 
 void UpdateWindowTitle ()
@@ -94,39 +105,72 @@ void UpdateWindowTitle ()
 
 
 
+//
+// ReportGates
+// Warn about gates with no matching gate in another dimension, or with
+// more than one (they lead to the lowest numbered dimension)
+//
+void ReportGates ()
+{
+    int         w, x, y, matches;
+    tiletype_t  type;
+    
+    for (w=0 ; w<map.numdims ; w++) {
+        for (y=0 ; y<map.height ; y++) {
+            for (x=0 ; x<map.width ; x++) {
+                type = MapType(w, x, y);
+                if (type != TT_GATE_H && type != TT_GATE_V)
+                    continue;
+                matches = GateMatches(w, x, y);
+                if (matches == 0)
+                    printf("OpenMap: Warning! Gate at %d, %d (dimension %d) leads nowhere\n", x, y, w+1);
+                else if (matches > 1)
+                    printf("OpenMap: Warning! Gate at %d, %d (dimension %d) matches %d dimensions\n", x, y, w+1, matches);
+            }
+        }
+    }
+}
+
+
+
+
 void OpenMap (int number)
 {
     int     x, y;
-    FILE    *stream;
+    int     size;
     
     // TODO level number range check
     sprintf(filename, FILE_FORMAT, number);
     
     if (!FileExists(filename))
     {
-        for (dim=0 ; dim<NUMDIMS ; dim++) {
-            for (y=0 ; y<MAPSIZE ; y++) {
-                for (x=0 ; x<MAPSIZE ; x++) {
-                    map[dim][y][x].type = TT_WALL;
-                    map[dim][y][x].id = dim;
+        // new map: -mapsize <tiles> sets width and height
+        size = (x = CheckParm("-mapsize")) && x < myargc-1 ? atoi(myargv[x+1]) : MAPSIZE;
+        if (!AllocMap(size, size, NUMDIMS))
+            Quit("OpenMap: Error, could not allocate map.");
+        for (dim=0 ; dim<map.numdims ; dim++) {
+            for (y=0 ; y<map.height ; y++) {
+                for (x=0 ; x<map.width ; x++) {
+                    SetMapTile(dim, x, y, MakeTile(TT_WALL, dim));
                 }
             }
         }
-        stream = fopen(filename, "wb"); // create the file
-        fclose(stream);
+        BuildMapTables();
+        if (!WriteMapFile(filename)) // create the file
+            Quit("OpenMap: Error, could not create file.");
         printf("OpenMap: Created map file %s\n", filename);
     }
     else // open and load existing file:
     {
-        stream = fopen(filename, "rb");
-        if (!stream)
-            Quit("OpenMap: Error, could not open file.");
-        fread(map, sizeof(map), 1, stream);
-        fclose(stream);
+        if (!ReadMapFile(filename))
+            Quit("OpenMap: Error, could not load file.");
         printf("OpenMap: Loaded %s\n", filename);
+        ReportGates();
     }
     
-    UpdateWindowTitle();
+    if (window)
+        UpdateWindowTitle();
+    texturesvalid = false; // drawn on entering the editor
     mapnum = number;
     dim = 0;
 }
@@ -136,43 +180,177 @@ void OpenMap (int number)
 
 void SaveMap ()
 {
-    FILE *stream;
-    
     //    sprintf(filename, FILE_FORMAT, mapnum);
     
-    stream = fopen(filename, "wb");
-    if (!stream) {
-        printf("SaveMap: Warning! Could not open file %s\n", filename);
+    if (!WriteMapFile(filename)) {
+        printf("SaveMap: Warning! Could not save file %s\n", filename);
         return;
     }
-    fwrite(map, sizeof(map), 1, stream);
-    fclose(stream);
     printf("SaveMap: Saved map to file %s\n", filename);
 }
 
 
 
 
+#pragma mark - Text Printing
+
+void gotoxy (int x, int y)
+{
+    csrx = x;
+    csry = y;
+}
+
+// print char at cursor location
+void printc (int x, int y, int ch)
+{
+    gotoxy(x, y);
+    SDL_Rect src = { (ch%32)*FONT_W, ch/32*FONT_H, FONT_W, FONT_H };
+    SDL_Rect dst = { x*FONT_W, y*FONT_H, FONT_W, FONT_H };
+    SDL_RenderCopy(renderer, text, &src, &dst);
+}
+
+
+#if 0
+// print char centered at tile x, y
+void drawchar (int x, int y, int ch)
+{
+    SDL_Rect src = { (ch%16)*FONT_W, ch/16*FONT_H, FONT_W, FONT_H };
+    SDL_Rect dst = { x+2, y, FONT_W, FONT_H };
+    SDL_RenderCopy(renderer, text, &src, &dst);;
+}
+#endif
+
+// print string at cursor x, y
+void print (int x, int y, const char *string)
+{
+    gotoxy(x, y);
+    char *c = (char *)string;
+    while (*c != '\0')
+    {
+        printc(csrx, csry, *c);
+        c++;
+        csrx++;
+    }
+}
+
+// print integer at cursor x, y
+void printd (int x, int y, int d)
+{
+    gotoxy(x, y);
+    char buffer[80];
+    sprintf(buffer, "%d", d);
+    print(x, y, buffer);
+}
+
+#pragma mark -
+
+
+
+
 //
-// MouseTile
-// Returns a pointer to the map tile currently
-// under the mouse pointer
+// DrawTileType
+// Draw a tile of type t in dimension w, top left corner at pixel x, y,
+// with its grid point
 //
-tile_t *MouseTile ()
+void DrawTileType (tiletype_t t, int w, int x, int y)
 {
-    int x, y;
-    GetMouseTile(&x, &y);
-    return &map[dim][y][x];
+    SDL_Rect            dst;
+    const SDL_Color     *c;
+    
+    dst = (SDL_Rect){ x, y, TILESIZE, TILESIZE };
+    
+    switch (t) {
+        case TT_WALL:
+            c = &colors[w % (sizeof(colors) / sizeof(colors[0]))];
+            SDL_SetRenderDrawColor(renderer, c->r, c->g, c->b, 255);
+            SDL_RenderFillRect(renderer, &dst);
+            break;
+            
+        default:
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+            SDL_RenderFillRect(renderer, &dst);
+            if (t != TT_EMPTY)
+                printc(x / FONT_W, y / FONT_H, symbols[t]);
+            break;
+    }
+    
+    SDL_SetRenderDrawColor(renderer, 64, 64, 64, 255);
+    SDL_RenderDrawPoint(renderer, x, y);
 }
 
 
 
 
-void SetTile (tiletype_t type, int id)
+//
+// BuildMapTextures
+// Draw each dimension of the map into its own texture. Dimensions too big
+// for a texture are drawn tile by tile instead.
+//
+void BuildMapTextures ()
 {
-    tile_t *tile = MouseTile();
-    tile->type = type;
-    tile->id = id;
+    int w, x, y;
+    
+    for (w=0 ; w<MAXDIMS ; w++)
+    {
+        if (maptextures[w])
+            SDL_DestroyTexture(maptextures[w]);
+        maptextures[w] = NULL;
+        if (w >= map.numdims)
+            continue;
+        
+        maptextures[w] = SDL_CreateTexture(renderer,
+                                           SDL_PIXELFORMAT_ARGB8888,
+                                           SDL_TEXTUREACCESS_TARGET,
+                                           tilecoord(map.width),
+                                           tilecoord(map.height));
+        if (!maptextures[w]) {
+            printf("BuildMapTextures: Warning! No texture for dimension %d: %s\n", w+1, SDL_GetError());
+            continue;
+        }
+        
+        SDL_SetRenderTarget(renderer, maptextures[w]);
+        for (y=0 ; y<map.height ; y++) {
+            for (x=0 ; x<map.width ; x++) {
+                DrawTileType(MapType(w, x, y), w, tilecoord(x), tilecoord(y));
+            }
+        }
+    }
+    SDL_SetRenderTarget(renderer, NULL);
+    texturesvalid = true;
+}
+
+
+
+
+//
+// DrawMapTile
+// Update tile x, y of dimension w in its map texture
+//
+void DrawMapTile (int w, int x, int y)
+{
+    if (!texturesvalid || !maptextures[w])
+        return;
+    SDL_SetRenderTarget(renderer, maptextures[w]);
+    DrawTileType(MapType(w, x, y), w, tilecoord(x), tilecoord(y));
+    SDL_SetRenderTarget(renderer, NULL);
+}
+
+
+
+
+//
+// SetTile
+// Set the map tile under window point x, y, where the mouse event that
+// paints it happened: events can queue up while the mouse moves on
+//
+void SetTile (tiletype_t type, int id, int x, int y)
+{
+    WindowTile(&x, &y);
+    if (!InMap(x, y) || MapTile(dim, x, y) == MakeTile(type, id))
+        return;
+    SetMapTile(dim, x, y, MakeTile(type, id));
+    UpdateMapTables(dim, x, y);
+    DrawMapTile(dim, x, y);
 }
 
 
@@ -204,7 +382,7 @@ void DoKeyDown (SDL_Keycode key)
         default:
             break;
     }
-    if (key >= '1' && key <= '5')
+    if (key >= '1' && key < '1' + map.numdims)
         dim = key - '1';
 }
 
@@ -218,22 +396,22 @@ void DoMouseDown (uint8_t button, int x, int y)
     SDL_Rect    maprect = maparea;
     SDL_Rect    menurect = menu;
     
-    maprect.w *= SCALE;
-    maprect.h *= SCALE;
-    menurect.y *= SCALE;
-    menurect.w *= SCALE;
-    menurect.h *= SCALE;
+    maprect.w *= winscale;
+    maprect.h *= winscale;
+    menurect.y *= winscale;
+    menurect.w *= winscale;
+    menurect.h *= winscale;
     
     switch (button) {
         case SDL_BUTTON_LEFT:
             if (SDL_PointInRect(&clickpt, &maprect))
             {
                 if (keys[SDL_SCANCODE_X])
-                    SetTile(TT_EMPTY, 0);
+                    SetTile(TT_EMPTY, 0, x, y);
                 else
-                    SetTile(selected, 0);
+                    SetTile(selected, 0, x, y);
             } else if (SDL_PointInRect(&clickpt, &menurect)) {
-                selected = clickpt.x / SCALE / TILESIZE;
+                selected = clickpt.x / winscale / TILESIZE;
                 if (selected >= TT_COUNT)
                     selected = TT_COUNT-1;
             }
@@ -247,117 +425,88 @@ void DoMouseDown (uint8_t button, int x, int y)
 
 
 
-#pragma mark - Text Printing
-
-void gotoxy (int x, int y)
-{
-    csrx = x;
-    csry = y;
-}
-
-// print char at cursor location
-void printc (int x, int y, int ch)
-{
-    gotoxy(x, y);
-    SDL_Rect src = { (ch%32)*FONT_W, ch/32*FONT_H, FONT_W, FONT_H };
-    SDL_Rect dst = { x*FONT_W, y*FONT_H, FONT_W, FONT_H };
-    SDL_RenderCopy(renderer, text, &src, &dst);
-}
-
-
-#if 0
-// print char centered at tile x, y
-void drawchar (int x, int y, int ch)
-{
-    SDL_Rect src = { (ch%16)*FONT_W, ch/16*FONT_H, FONT_W, FONT_H };
-    SDL_Rect dst = { x+2, y, FONT_W, FONT_H };
-    SDL_RenderCopy(renderer, text, &src, &dst);;
-}
-#endif
-
-// print string at cursor x, y
-void print (int x, int y, const char *string)
+//
+// DrawMap
+// Draw the part of the current dimension inside the map area
+//
+void DrawMap ()
 {
-    gotoxy(x, y);
-    char *c = (char *)string;
-    while (*c != '\0')
+    int         x, y;
+    int         x1, y1, x2, y2;
+    SDL_Rect    src, dst;
+    
+    SDL_RenderSetViewport(renderer, &maparea);
+    
+    if (maptextures[dim])
     {
-        printc(csrx, csry, *c);
-        c++;
-        csrx++;
+        // copy the visible part of the cached map
+        x1 = originx < 0 ? 0 : originx;
+        y1 = originy < 0 ? 0 : originy;
+        x2 = originx + maparea.w;
+        y2 = originy + maparea.h;
+        if (x2 > tilecoord(map.width))
+            x2 = tilecoord(map.width);
+        if (y2 > tilecoord(map.height))
+            y2 = tilecoord(map.height);
+        if (x2 <= x1 || y2 <= y1)
+            return;
+        
+        src = (SDL_Rect){ x1, y1, x2 - x1, y2 - y1 };
+        dst = (SDL_Rect){ x1 - originx, y1 - originy, x2 - x1, y2 - y1 };
+        SDL_RenderCopy(renderer, maptextures[dim], &src, &dst);
+        return;
     }
-}
-
-// print integer at cursor x, y
-void printd (int x, int y, int d)
-{
-    gotoxy(x, y);
-    char buffer[80];
-    sprintf(buffer, "%d", d);
-    print(x, y, buffer);
-}
-
-#pragma mark -
-
-
-
-
-// x and y are tile coords!
-void DrawTileType (tiletype_t t, int x, int y)
-{
-    SDL_Rect    dst;
-    SDL_Color   *c;
     
-    dst = (SDL_Rect){ drawx(x), drawy(y), TILESIZE, TILESIZE };
+    // no texture: draw the visible tiles
+    x1 = originx < 0 ? 0 : originx / TILESIZE;
+    y1 = originy < 0 ? 0 : originy / TILESIZE;
+    x2 = (originx + maparea.w) / TILESIZE + 1;
+    y2 = (originy + maparea.h) / TILESIZE + 1;
+    if (x2 > map.width)
+        x2 = map.width;
+    if (y2 > map.height)
+        y2 = map.height;
     
-    switch (t) {
-        case TT_EMPTY:
-            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-            SDL_RenderFillRect(renderer, &dst);
-            break;
-        case TT_WALL:
-            c = (SDL_Color *)&colors[dim];
-            SDL_SetRenderDrawColor(renderer, c->r, c->g, c->b, 255);
-            SDL_RenderFillRect(renderer, &dst);
-            break;
-            
-        default:
-            printc(x-originx/TILESIZE, y-originy/TILESIZE, symbols[t]);
-            break;
+    for (y=y1 ; y<y2 ; y++) {
+        for (x=x1 ; x<x2 ; x++) {
+            DrawTileType(MapType(dim, x, y), dim, drawx(x), drawy(y));
+        }
     }
 }
 
 
 
 
+//
+// EditorLoop
+// The editor only redraws after something changes, and sleeps in
+// SDL_WaitEvent while idle
+//
 void EditorLoop()
 {
     SDL_Event   event;
     SDL_Rect    dst;
-    uint32_t    mousestate;
-    SDL_Point   clickpt;
-    int         x, y;
-    SDL_Rect    mapconv = maparea;
-    SDL_Rect    menuconv = menu;
+    int         x;
+    bool        redraw;
     
     selected = TT_PLAYERSTART;
-    mapconv.w *= SCALE;
-    mapconv.h *= SCALE;
-    menuconv.y *= SCALE;
-    menuconv.w *= SCALE;
-    menuconv.h *= SCALE;
     
     int w, h;
     SDL_GetWindowSize(window, &w, &h);
-    if (w != EDITOR_WIN_W*SCALE || h != EDITOR_WIN_H*SCALE)
-        SDL_SetWindowSize(window, EDITOR_WIN_W*SCALE, EDITOR_WIN_H*SCALE);
+    if (w != EDITOR_WIN_W*winscale || h != EDITOR_WIN_H*winscale)
+        SDL_SetWindowSize(window, EDITOR_WIN_W*winscale, EDITOR_WIN_H*winscale);
+    
+    if (!texturesvalid)
+        BuildMapTextures();
+    redraw = true;
     
     do
     {
-        SDL_PumpEvents();
+        if (!redraw)
+            SDL_WaitEvent(NULL); // idle
         
         //
-        // KEYBOARD INPUT
+        // INPUT
         //
         
         while (SDL_PollEvent(&event))
@@ -368,39 +517,35 @@ void EditorLoop()
                     break;
                 case SDL_KEYDOWN:
                     DoKeyDown(event.key.keysym.sym);
+                    redraw = true;
                     break;
                 case SDL_MOUSEBUTTONDOWN:
-                    //DoMouseDown(event.button.button, event.motion.x, event.motion.y);
+                    DoMouseDown(event.button.button, event.button.x, event.button.y);
+                    redraw = true;
                     break;
                 case SDL_MOUSEMOTION:
                     UpdateWindowTitle();
+                    if (event.motion.state & SDL_BUTTON_LMASK) { // painting
+                        DoMouseDown(SDL_BUTTON_LEFT, event.motion.x, event.motion.y);
+                        redraw = true;
+                    }
+                    break;
+                case SDL_WINDOWEVENT:
+                    redraw = true;
+                    break;
+                case SDL_RENDER_TARGETS_RESET:
+                case SDL_RENDER_DEVICE_RESET:
+                    BuildMapTextures(); // contents lost
+                    redraw = true;
+                    break;
                 default:
                     break;
             }
         }
         
-        
-        //
-        // MOUSE INPUT
-        //
-        
-        mousestate = SDL_GetMouseState(&clickpt.x, &clickpt.y);
-        
-        // handle left click
-        if (mousestate & SDL_BUTTON_LMASK)
-        {
-            if (SDL_PointInRect(&clickpt, &mapconv))
-            {
-                if (keys[SDL_SCANCODE_X])
-                    SetTile(TT_EMPTY, 0);
-                else
-                    SetTile(selected, 0);
-            } else if (SDL_PointInRect(&clickpt, &menuconv)) {
-                selected = clickpt.x / SCALE / TILESIZE;
-                if (selected >= TT_COUNT)
-                    selected = TT_COUNT-1;
-            }
-        }
+        if (!redraw || gamestate != GS_EDITOR)
+            continue;
+        redraw = false;
         
         //
         // RENDER
@@ -410,24 +555,7 @@ void EditorLoop()
         SDL_RenderClear(renderer);
         
         // MAP AREA
-        
-        SDL_RenderSetViewport(renderer, &maparea);
-        
-        // draw map
-        for (y=0 ; y<MAPSIZE ; y++) {
-            for (x=0 ; x<MAPSIZE ; x++)
-            {
-                DrawTileType(map[dim][y][x].type, x, y);
-            }
-        }
-        
-        // draw grid
-        SDL_SetRenderDrawColor(renderer, 64, 64, 64, 255);
-        for (y=0 ; y<MAPSIZE*TILESIZE ; y+=TILESIZE) {
-            for (x=0 ; x<MAPSIZE*TILESIZE ; x+=TILESIZE) {
-                SDL_RenderDrawPoint(renderer, x-originx, y-originy);
-            }
-        }
+        DrawMap();
         
         // MENU AREA
         SDL_RenderSetViewport(renderer, &menu);
@@ -7,12 +7,16 @@
 //
 
 #include <math.h>
+#include <ctype.h>
+#include <strings.h>
+#ifdef __APPLE__
 #include <SDL2_image/SDL_image.h>
+#else
+#include <SDL2/SDL_image.h>
+#endif
 
 #include "labyrinth.h"
 
-#define SHADE 1
-
 SDL_Window      *window;
 SDL_Renderer    *renderer;
 const uint8_t   *keys;
@@ -21,21 +25,25 @@ SDL_Texture     *walltextures[WT_COUNT];
 SDL_Texture     *text;
 
 gamestate_t     gamestate;
-const float     fov = ANG90 / 2;
-const float     depth = 16.0f;
-const int       halfheight = WIN_H / 2;
+int             winscale = DEFAULT_SCALE;
+int             myargc;
+char            **myargv;
 //int           wallindex; // which wall to draw, set by CheckBlock
 obj_t           player;
 
 // 'map' represents the entire "5-dimensional" world:
-// an array of NUMDIMS 2D-64*64 areas
-tile_t map[NUMDIMS][MAPSIZE][MAPSIZE];
+// map.numdims 2D areas of map.width*map.height tiles
+map_t map;
+
+int             fpslimit = -1;  // -fps: frame rate cap, 0 for none, -1 for vsync
+uint64_t        nextframe;      // when PaceFrame lets the next frame start
 
 
 
 
 void Quit (const char *error)
 {
+    WriteTrace();
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
@@ -50,18 +58,34 @@ void Quit (const char *error)
 
 
 //
-// ProcessInput
-// Process all user input
-// App quit
-// player rotate/movement
+// CheckParm
+// Returns the argument number (1 to argc-1)
+// or 0 if not present
 //
-void ProcessInput (void)
+int CheckParm (const char *check)
 {
-    //	const float	adjust = 0.1f;
-    //	const float strafeadj = 0.5f;
+    int i;
     
+    for (i=1 ; i<myargc ; i++)
+    {
+        if (!strcasecmp(check, myargv[i]))
+            return i;
+    }
+    return 0;
+}
+
+
+
+
+//
+// ProcessEvents
+// Handle key presses and window events, once per frame
+// App quit
+// editor, profiler toggle
+//
+void ProcessEvents (void)
+{
     SDL_Event 	ev;
-    float		max, min;
     
     while (SDL_PollEvent(&ev)) {
         if (ev.type == SDL_QUIT)
@@ -76,12 +100,30 @@ void ProcessInput (void)
                     if (Ctrl())
                         gamestate = GS_EDITOR;
                     break;
+                case SDLK_F3:
+                    showprofile = !showprofile;
+                    break;
                 default:
                     break;
             }
         }
     }
+}
+
+
+
+
+//
+// ProcessInput
+// Process held keys, once per tick
+// player rotate/movement
+//
+void ProcessInput (void)
+{
+    //	const float	adjust = 0.1f;
+    //	const float strafeadj = 0.5f;
     
+    float		max, min;
     
     // rotate
     if (keys[SDL_SCANCODE_LEFT])
@@ -133,78 +175,94 @@ void ProcessInput (void)
 
 bool WallCollision (obj_t *obj)
 {
-    return (map[obj->w][(int)obj->top][(int)obj->left].type == TT_WALL ||
-            map[obj->w][(int)obj->top][(int)obj->right].type == TT_WALL ||
-            map[obj->w][(int)obj->bottom][(int)obj->left].type == TT_WALL ||
-            map[obj->w][(int)obj->bottom][(int)obj->right].type == TT_WALL);
+    return (MapType(obj->w, (int)obj->left, (int)obj->top) == TT_WALL ||
+            MapType(obj->w, (int)obj->right, (int)obj->top) == TT_WALL ||
+            MapType(obj->w, (int)obj->left, (int)obj->bottom) == TT_WALL ||
+            MapType(obj->w, (int)obj->right, (int)obj->bottom) == TT_WALL);
 }
 
 
 
 
-void RenderFloorAndCeiling(SDL_Color *floor, SDL_Color *ceiling)
+//
+// InterpolateView
+// Place 'camera' 'frac' of the way from the player's state before the
+// last tick ('old') to its current state, so frames drawn between ticks
+// move smoothly. A tick that changed dimension isn't interpolated.
+//
+void InterpolateView (obj_t *old, obj_t *camera, float frac)
 {
-    int a;
-    SDL_Rect rect = { 0, 0, WIN_W, WIN_H };
-
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderFillRect(renderer, &rect);
-    rect.h = 1;
-    for (; rect.y<WIN_H ; rect.y++)
-    {
-        if (rect.y < halfheight) {
-            a = (rect.y) * 2;
-            SDL_SetRenderDrawColor(renderer, ceiling->r, ceiling->g, ceiling->b, 255-a);
-        } else {
-            a = (halfheight - rect.y) * 2;
-            SDL_SetRenderDrawColor(renderer, floor->r, floor->g, floor->b, 255-a);
-        }
-        SDL_RenderFillRect(renderer, &rect);
-    }
+    float turn;
+    
+    *camera = player;
+    if (old->w != player.w)
+        return;
+    
+    camera->x = old->x + (player.x - old->x) * frac;
+    camera->y = old->y + (player.y - old->y) * frac;
+    
+    // turn the short way round
+    turn = player.angle - old->angle;
+    if (turn > ANG180)
+        turn -= ANGLES;
+    else if (turn < -ANG180)
+        turn += ANGLES;
+    SetAngle(camera, old->angle + turn * frac);
 }
 
 
 
 
 //
-// CalcHeight
-// Calulate wall height
+// PaceFrame
+// With -fps <n>, wait until it's time to start the next frame. Sleeps for
+// most of the wait and spins for the last ms or two, as SDL_Delay can
+// oversleep. Frames are kept on a fixed schedule so the waits don't drift,
+// unless the game falls more than a frame behind.
 //
-int CalcHeight (float xintercept, float yintercept)
+void PaceFrame (void)
 {
-    float dx, dy;
-    float distadj;
-    int ceiling, floor;
+    uint64_t    now, period;
+    uint32_t    ms;
     
-    dx = xintercept - player.x;
-    dy = yintercept - player.y;
-    distadj = dx * player.sin + dy * player.cos;
-    ceiling = (float)halfheight - (WIN_H / distadj);
-    floor = WIN_H - ceiling;
+    if (fpslimit <= 0)
+        return; // vsync or uncapped
     
-    return floor - ceiling;
+    period = SDL_GetPerformanceFrequency() / fpslimit;
+    now = SDL_GetPerformanceCounter();
+    if (now < nextframe)
+    {
+        ms = (uint32_t)((nextframe - now) * 1000 / SDL_GetPerformanceFrequency());
+        if (ms > 2)
+            SDL_Delay(ms - 2);
+        while (SDL_GetPerformanceCounter() < nextframe)
+            ;
+    }
+    else if (now - nextframe > period)
+        nextframe = now;
+    nextframe += period;
 }
 
 
 
 
-
+//
+// PlayLoop
+// Input is read and the player moved at a fixed TICRATE, however fast
+// frames are drawn. Each frame is drawn interpolated between the last two
+// ticks.
+//
 void PlayLoop (void)
 {
-    int 	x, y;
-    float	dist;
-    int		wallheight;
-    tile_t	tile;
-    obj_t	ray;
-    point	raydir;
-    SDL_Surface *s;
+    obj_t       old, camera;
+    uint64_t    now, last, tic, elapsed;
     
     // INIT PLAYER
     
-    for (int w=0 ; w<NUMDIMS ; w++) {
-        for (int y=0 ; y<MAPSIZE ; y++) {
-            for (int x=0 ; x<MAPSIZE ; x++) {
-                if (map[w][y][x].type == TT_PLAYERSTART) {
+    for (int w=0 ; w<map.numdims ; w++) {
+        for (int y=0 ; y<map.height ; y++) {
+            for (int x=0 ; x<map.width ; x++) {
+                if (MapType(w, x, y) == TT_PLAYERSTART) {
                     player.x = x + 0.5f;
                     player.y = y + 0.5f;
                     player.w = w;
@@ -215,133 +273,104 @@ void PlayLoop (void)
     player.r = PL_RADIUS;
     player.oldx = player.x;
     player.oldy = player.y;
-    player.ingate = false;
-    player.entryside = -1;
     SetAngle(&player, M_PI/2);
     
-    ray.type = OT_RAY;
-    ray.r = 0;
+    ClearActors();
+    SpawnActors(numactors);
     
     int w, h;
     SDL_GetWindowSize(window, &w, &h);
-    if (w != WIN_W*SCALE || h != WIN_H*SCALE)
-        SDL_SetWindowSize(window, WIN_W*SCALE, WIN_H*SCALE);
+    if (w != winw*winscale || h != winh*winscale)
+        SDL_SetWindowSize(window, winw*winscale, winh*winscale);
+    
+    old = player;
+    tic = SDL_GetPerformanceFrequency() / TICRATE;
+    elapsed = 0;
+    last = SDL_GetPerformanceCounter();
     
     // game loop
     do
     {
-        ProcessInput();
-        ControlMovement(&player);
-        CheckBlock(&player); 	// do collisions and gate stuff
+        PaceFrame();
         
-        // RENDER
-
-        SDL_Color f = { 64, 64, 64 };
-        SDL_Color c = { 128, 32, 0 };
-        RenderFloorAndCeiling(&f, &c);
+        now = SDL_GetPerformanceCounter();
+        elapsed += now - last;
+        last = now;
+        if (elapsed > MAXTICS * tic)
+            elapsed = MAXTICS * tic; // stalled (or too slow): don't try to catch up
         
-        for (x=0; x < WIN_W; x++)
+        PROFILE_BEGIN(PS_INPUT, 0);
+        ProcessEvents();
+        PROFILE_END(PS_INPUT, 0);
+        
+        // SIMULATE
+        
+        for ( ; elapsed >= tic ; elapsed -= tic)
         {
-            // set view angle
-            SetAngle(&ray, (player.angle+fov/2.0f) - ((float)x/WIN_W*fov));
-            dist = 0;
-            ray.w = player.w; // start ray cast in current dimension
-            ray.ingate = false;
-            raydir = (point){ ray.sin, ray.cos }; // set ray direction (unit vector)
-            float samplex = 0;
-            
-            while (dist < MAPSIZE)
-            {
-                // extend vector out
-                SetPosition(&ray, player.x+raydir.x*dist, player.y+raydir.y*dist);
-                tile = map[ray.w][ray.tiley][ray.tilex];
-                
-                CheckBlock(&ray);
-                
-                if (tile.type == TT_WALL)
-                {
-                    float angle = atan2f(ray.y-(ray.tiley+0.5f), ray.x-(ray.tilex+0.5f));
-                    float rc = M_PI*0.25; // upper (or lower) right corner
-                    float lc = M_PI*0.75;
-                    
-                    if ((angle >= -rc && angle < rc) ||
-                        (angle >= lc || angle < -lc))
-                    {
-                        samplex = ray.y - ray.tiley; // hit right or left side
-                    } else {
-                        samplex = ray.x - ray.tilex; // hit top or bottom side
-                    }
-                    break; // done casting ray
-                }
-                
-                // extend ray distance and check again:
-                dist += 0.01f;
-            } // while (dist < MAP_W)
-            
-            // assume tile.type == TT_WALL:
-            if (map[ray.w][(int)ray.oldy][(int)ray.oldx].type == TT_GATE_H ||
-                map[ray.w][(int)ray.oldy][(int)ray.oldx].type == TT_GATE_V)
-            {
-                s = walls[WT_FIRE];
-            } else {
-                s = walls[ray.w];
-            }
-            //			s = ray.ingate ? walls[WT_FIRE] : walls[ray.w];
-            
-            wallheight = CalcHeight(ray.x, ray.y);
-            float ceiling = halfheight-wallheight/2;
-            float floor = halfheight+wallheight/2;
-            
-            // draw walls
-            SDL_LockSurface(s);
-            for (y=ceiling ; y<floor ; y++)
-            {
-                if (y < 0 || y > WIN_H) continue;
-                float sampley = ((float)y - ceiling) / (float)wallheight;
-                
-                
-                int pixely = (int)(sampley * s->h);
-                int pixelx = (int)(samplex * s->w);
-                uint8_t pixel = *((uint8_t *)s->pixels + pixely * s->w + pixelx);
-                uint8_t r, g, b;
-                SDL_GetRGB(pixel, s->format, &r, &g, &b);
-                SDL_SetRenderDrawColor(renderer, r, g, b, 255);
-                SDL_RenderDrawPoint(renderer, x, y);
-                
-            }
-            SDL_UnlockSurface(s);
-#if SHADE
-            SDL_Rect dark = { x, ceiling, 1, wallheight };
-            int alpha = 255-wallheight*1.5f; // 2
-            if (alpha < 0)
-                alpha = 0;
-            SDL_SetRenderDrawColor(renderer, 0, 0, 0, alpha);
-            SDL_RenderFillRect(renderer, &dark);
-#endif
+            old = player;
+            PROFILE_BEGIN(PS_INPUT, 0);
+            ProcessInput();
+            PROFILE_END(PS_INPUT, 0);
+            PROFILE_BEGIN(PS_MOVEMENT, 0);
+            ControlMovement(&player);
+            MoveActors();
+            PROFILE_END(PS_MOVEMENT, 0);
         }
         
-        SDL_RenderPresent(renderer);
+        // RENDER
+        
+        actorfrac = (float)elapsed / tic;
+        InterpolateView(&old, &camera, actorfrac);
+        RenderView(&camera);
+        PresentFrame();
+        PROFILE_FRAME();
     } while (gamestate == GS_PLAY);
 }
 
 
 
 
-int main (void)
+int main (int argc, char **argv)
 {
     int	i;
+    int bench;
     
-    // INIT SDL, WINDOW, RENDERER
+    myargc = argc;
+    myargv = argv;
+    
+    // view size: -width <pixels> -height <pixels> -scale <window scale>
     
-    if (SDL_Init(SDL_INIT_VIDEO) != 0) Quit("SDL_Init failed");
+    winw = (i = CheckParm("-width")) && i < myargc-1 ? atoi(myargv[i+1]) : DEFAULT_W;
+    winh = (i = CheckParm("-height")) && i < myargc-1 ? atoi(myargv[i+1]) : DEFAULT_H;
+    winscale = (i = CheckParm("-scale")) && i < myargc-1 ? atoi(myargv[i+1]) : DEFAULT_SCALE;
+    if (winw < 1 || winh < 2 || winscale < 1) // at least a row of ceiling and of floor
+        Quit("Bad view size");
     
-    window = SDL_CreateWindow("Labyrinth", 0, 0, WIN_W*SCALE, WIN_H*SCALE, 0);
-    if (!window) Quit("SDL_CreateWindow failed");
+    // headless benchmark: -bench [map number] [-frames <count>]
     
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_PRESENTVSYNC);
-    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
-    if (!renderer) Quit("SDL_CreateRenderer failed");
-    SDL_RenderSetScale(renderer, SCALE, SCALE);
+    bench = CheckParm("-bench");
+    
+    // present mode: vsync by default, -fps <n> to pace frames at n per
+    // second instead, -fps 0 for as fast as possible
+    
+    if ((i = CheckParm("-fps")) && i < myargc-1)
+        fpslimit = atoi(myargv[i+1]) > 0 ? atoi(myargv[i+1]) : 0;
+    
+    // INIT SDL, WINDOW, RENDERER
+    
+    if (SDL_Init(bench ? 0 : SDL_INIT_VIDEO) != 0) Quit("SDL_Init failed");
+    
+    if (!bench)
+    {
+        window = SDL_CreateWindow("Labyrinth", 0, 0, winw*winscale, winh*winscale, 0);
+        if (!window) Quit("SDL_CreateWindow failed");
+        
+        renderer = SDL_CreateRenderer(window, -1, fpslimit < 0 ? SDL_RENDERER_PRESENTVSYNC : 0);
+        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+        if (!renderer) Quit("SDL_CreateRenderer failed");
+        SDL_RenderSetScale(renderer, winscale, winscale);
+    }
+    SetViewSize(winw, winh);
     
     // INIT SURFACES & TEXTURES
     
@@ -355,10 +384,49 @@ int main (void)
     {
         if (!walls[i])
             Quit("Could not load wall surface");
+        if (bench)
+            continue;
         walltextures[i] = SDL_CreateTextureFromSurface(renderer, walls[i]);
         if (!walltextures[i])
             Quit("Could not load wall texture");
     }
+    InitTextureCache();
+    
+    // -depth <tiles>: how far rays go before fading out, 0 for no limit
+    if ((i = CheckParm("-depth")) && i < myargc-1)
+        viewdepth = atof(myargv[i+1]) > 0 ? atof(myargv[i+1]) : INFINITY;
+    
+    // -noskip: step rays through every tile, even in open areas
+    emptyskip = !CheckParm("-noskip");
+    
+    // -trace <file>: write a Chrome trace of every frame stage at exit
+    if ((i = CheckParm("-trace")) && i < myargc-1)
+        StartTrace(myargv[i+1]);
+    
+    // -texfloor: textured floor and ceiling instead of the gradients
+    SetTexturedFloor(CheckParm("-texfloor"));
+    
+    // -nosimd: cast one column at a time, without the vector units
+    SelectPacketCaster(!CheckParm("-nosimd"));
+    
+    // -raycache: reuse last frame's rays while the view only turns
+    raycache = CheckParm("-raycache");
+    
+    // -actors <count>: actors to scatter around each level
+    if ((i = CheckParm("-actors")) && i < myargc-1)
+        numactors = atoi(myargv[i+1]);
+    
+    // render threads: -threads <count>, defaults to one per core
+    i = CheckParm("-threads");
+    InitRenderThreads(i && i < myargc-1 ? atoi(myargv[i+1]) : SDL_GetCPUCount());
+    
+    if (bench)
+    {
+        i = CheckParm("-frames");
+        Benchmark(bench < myargc-1 && isdigit(*myargv[bench+1]) ? atoi(myargv[bench+1]) : 1,
+                  i && i < myargc-1 ? atoi(myargv[i+1]) : 0);
+        Quit(NULL);
+    }
     
     // text
     SDL_Surface *temp = IMG_Load("assets/cgafont.png");
@@ -11,16 +11,27 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#ifdef NOSDL
+// the headless simulation library (sim/) builds the game logic without SDL
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#else
 #include <SDL2/SDL.h>
+#endif
 
 #define bound(a,b,c)		a = a < b  ? b : a > c ? c : a
+#define clamp(x,lo,hi)		((x) < (lo) ? (lo) : (x) > (hi) ? (hi) : (x))
 #define sign(x)				x < 0 ? -1 : x > 0 ? 1 : 0
 #define signf(float)		float < 0.0f ? -1.0f : float > 0.0f ? 1.0f : 0.0f
 
-#define WIN_W				320
-#define WIN_H				200
-#define SCALE				3
+// default view size and window scale (-width, -height, -scale)
+#define DEFAULT_W			320
+#define DEFAULT_H			200
+#define DEFAULT_SCALE		3
 
+// size of a new map (-mapsize); loaded maps take their size from the file
 #define MAPSIZE				64
 
 #define ANGLES	 M_PI * 2
@@ -29,7 +40,8 @@
 #define ANG270	 ANG90 * 3
 
 
-#define NUMDIMS				5
+#define NUMDIMS				5	// in a new map
+#define MAXDIMS				9	// editor selects dimension with keys 1-9
 
 #define PL_RADIUS			0.25f
 #define PL_TURN 			0.025f
@@ -38,6 +50,12 @@
 #define PL_STRAFE_SPD		(PL_MOVE_SPD * 0.5f)
 #define PLAYER_MAX_SPEED	0.1f
 
+#define AC_RADIUS			0.2f	// actors, see actor.c
+#define AC_SPEED			0.03f
+
+#define TICRATE				60	// simulation ticks per second, PL_ values are per tick
+#define MAXTICS				6	// most ticks run for one frame, time past that is dropped
+
 typedef struct
 {
 	float x;
@@ -82,17 +100,63 @@ typedef enum
 	TT_COUNT
 } tiletype_t;
 
+// a tile is packed into one byte, in memory and in map files:
+// type in the low TILE_TYPEBITS, id in the rest
+// type is TT_WALL: id is which wall_t
+// type is TT_GATE: id indicates which dimension gate goes to (0..<map.numdims)
+typedef uint8_t tile_t;
+
+#define TILE_TYPEBITS		3
+#define TILE_TYPEMASK		((1 << TILE_TYPEBITS) - 1)
+
+#define MakeTile(type,id)	(tile_t)((type) | (id) << TILE_TYPEBITS)
+#define TileType(tile)		(tiletype_t)((tile) & TILE_TYPEMASK)
+#define TileId(tile)		((tile) >> TILE_TYPEBITS)
+
+// the world: numdims 2D areas of width*height tiles in one allocation,
+// indexed with MapTile
+typedef struct
+{
+	int			width;
+	int			height;
+	int			numdims;
+	tile_t		*tiles;
+	uint8_t		*gatelinks;	// per tile: dimension a gate there leads to,
+							// see BuildGateLinks
+	uint8_t		*skip;		// per tile: distance to nearest wall or gate,
+							// see BuildSkipField
+	unsigned	version;	// changed by every edit, for caches of map data
+	struct pathgraph_s	*paths;	// region graph for FindPath, see path.c
+} map_t;
+
+// an open (memory mapped) level file, see mapfile.c
 typedef struct
 {
-	tiletype_t type;
-	// type is TT_WALL: id is which wall_t
-	// type is TT_GATE: id indicates which dimension gate goes to (0..<NUMDIMS)
-	int id;
-} tile_t;
+	uint8_t		*data;
+	size_t		size;
+	bool		legacy;		// headerless original format
+	int			version;
+	int			numdims;
+	int			width;
+	int			height;
+} mapfile_t;
 
+// result of casting a ray, filled in by CastRay
 typedef struct
 {
-	float samplex;
+	float	dist;		// distance along ray to wall
+	float	x;			// wall intercept
+	float	y;
+	int		tilex;		// wall tile hit
+	int		tiley;
+	int		w;			// dimension wall was hit in
+	side_t	side;		// which face of the tile was hit
+	wall_t	texture;	// which wall surface to draw
+	float	samplex;	// texture column (0..1)
+	int		tiles;		// number of tiles the ray visited
+	int		height;		// projected wall height in pixels
+	float	depth;		// distance to the wall or the first gate crossed,
+						// INFINITY if neither: how far sprites are seen
 } drawinfo_t;
 
 typedef enum
@@ -127,10 +191,6 @@ typedef struct
 	// hit box
 	float	top,bottom,left,right; // updated by SetPosition
 	
-	// gate
-	bool	ingate; // obj in gate?
-	side_t	entryside;	// which side of gate
-	
 	// current dimension
 	int 	w;
 	
@@ -146,31 +206,233 @@ typedef struct
 
 // LABYRINTH.C
 
+#ifndef NOSDL
 extern SDL_Window 		*window;
 extern SDL_Renderer 	*renderer;
 extern SDL_Surface 		*walls[WT_COUNT];
 extern SDL_Texture		*walltextures[WT_COUNT];
 extern SDL_Texture		*text;
+#endif
+
+extern int				winscale;
+extern int				myargc;
+extern char				**myargv;
 
 extern obj_t 			player;
 extern gamestate_t 		gamestate;
 extern const uint8_t 	*keys;
-extern tile_t 			map[NUMDIMS][MAPSIZE][MAPSIZE];
+#ifdef NOSDL
+extern _Thread_local map_t	map;	// headless tools: a level per thread
+#else
+extern map_t			map;
+#endif
+
+// map accessors: x, y in tiles
+static inline bool InMap (int x, int y)
+{
+	return x >= 0 && x < map.width && y >= 0 && y < map.height;
+}
+
+static inline tile_t MapTile (int w, int x, int y)
+{
+	return map.tiles[(w * map.height + y) * map.width + x];
+}
+
+static inline tiletype_t MapType (int w, int x, int y)
+{
+	return TileType(MapTile(w, x, y));
+}
+
+static inline void SetMapTile (int w, int x, int y, tile_t tile)
+{
+	map.tiles[(w * map.height + y) * map.width + x] = tile;
+}
 
 void Quit (const char *error);
+int CheckParm (const char *check);
 
 // OBJECT.C
 
-void CheckBlock (obj_t *obj);
+#define SLIDE_PASSES	4		// surfaces or gates one move can meet
+#define SLIDE_GAP		0.001f	// how far off a surface a move stops
+
+// where a moving circle first touches something, see SlideMove
+typedef struct
+{
+	float	t;		// fraction of the move made before touching
+	float	nx, ny;	// surface normal there
+} contact_t;
+
+int GateMatches (int w, int x, int y);
+int UpdateGateLinks (int x, int y);
+int BuildGateLinks (void);
+int GateDestination (int w, int x, int y);
 void SetAngle (obj_t *obj, float a);
 void SetPosition (obj_t *obj, float x, float y);
-void Thrust (float angle, float speed);
+void SweepCircle (float x, float y, float xmove, float ymove,
+				  float cx, float cy, float radius, contact_t *contact);
+void SlideMove (int *w, float *x, float *y, float r, float xmove, float ymove,
+				int actor);
 void ControlMovement (obj_t *obj);
 
+// ACTOR.C
+
+// the actor pool, one array per field: actor i is at x[i], y[i] and so on
+typedef struct
+{
+	int		count;
+	int		capacity;
+	float	*x, *y;
+	float	*oldx, *oldy;	// position before the last tick
+	float	*dx, *dy;		// velocity, tiles per tick
+	float	*r;
+	int		*w;
+	int		*cell;			// grid cell the actor is linked into
+	int		*next, *prev;	// other actors in the cell, -1 at the ends
+} actors_t;
+
+extern actors_t			actors;
+extern int				*actorcells;	// per dimension per tile, see ActorCell
+extern int				numactors;
+extern float			actorfrac;
+extern uint32_t			actorseed;
+
+int ActorCell (int w, float x, float y);
+void ClearActors (void);
+void SweepActors (int w, float x, float y, float r, float xmove, float ymove,
+				  int ignore, contact_t *contact);
+int SpawnActor (int w, float x, float y, float angle);
+void SpawnActors (int count);
+void MoveActors (void);
+
+// PATH.C
+
+#define PATH_CLUSTER	8	// tiles across a pathfinding cluster
+#define PATH_REGIONS	(2 * PATH_CLUSTER * PATH_CLUSTER) // most a cluster can hold
+
+// one tile along a path
+typedef struct
+{
+	int		w, x, y;
+} pathstep_t;
+
+void FreePathGraph (struct pathgraph_s *graph);
+void BuildPathGraph (void);
+void UpdatePathGraph (int x, int y);
+bool PathReachable (int w, int x, int y, int goalw, int goalx, int goaly);
+int MarkReachable (int w, int x, int y, uint8_t *reached);
+int FindPath (int w, int x, int y, int goalw, int goalx, int goaly,
+			  pathstep_t *path, int maxsteps);
+
+// RAYCAST.C
+
+extern bool				emptyskip;
+
+void UpdateSkipField (int w, int x1, int y1, int x2, int y2);
+void BuildSkipField (void);
+bool CastRay (float x, float y, int w, float dirx, float diry, float maxdist,
+			  drawinfo_t *info);
+
+// RENDER.C
+
+extern int				winw;
+extern int				winh;
+extern int				halfheight;
+extern float			*colsin;	// view angle of each screen column
+extern float			*colcos;
+extern int				numthreads;
+extern float			viewdepth;
+extern obj_t			view;
+extern bool				raycache;
+extern int				raycount;	// rays cast in the last frame
+extern int				tilecount;	// tiles visited by those rays
+
+void SetViewSize (int width, int height);
+int CalcHeight (float distadj);
+void InitTextureCache (void);
+void SetTexturedFloor (bool on);
+void InitRenderThreads (int count);
+void RenderView (obj_t *camera);
+void PresentFrame (void);
+
+// RAYPACKET.C
+
+#define MAXLANES		8	// widest packet
+
+extern int				packetlanes;
+extern const char		*packetname;
+
+void SelectPacketCaster (bool allowed);
+int CastPacket (int column, drawinfo_t *info, int *scalar);
+
+// BENCH.C
+
+int CompareFloats (const void *a, const void *b);
+void Benchmark (int mapnum, int numframes);
+
+// PROFILE.C
+
+#define PROFILE			1	// 0 compiles the frame-stage timers out
+
+typedef enum
+{
+	PS_INPUT,
+	PS_MOVEMENT,
+	PS_BACKGROUND,	// floor and ceiling
+	PS_CAST,
+	PS_WALLS,
+	PS_SPRITES,
+	PS_UPLOAD,		// framebuffer to the frame texture
+	PS_PRESENT,
+	PS_COUNT
+} stage_t;
+
+#if PROFILE
+#define PROFILE_BEGIN(stage, thread)	ProfileBegin(stage, thread)
+#define PROFILE_END(stage, thread)		ProfileEnd(stage, thread)
+#define PROFILE_FRAME()					ProfileFrame()
+#else
+#define PROFILE_BEGIN(stage, thread)
+#define PROFILE_END(stage, thread)
+#define PROFILE_FRAME()
+#endif
+
+extern bool				showprofile;
+
+void ProfileBegin (stage_t stage, int thread);
+void ProfileEnd (stage_t stage, int thread);
+void ProfileFrame (void);
+void DrawProfile (void);
+void StartTrace (const char *filename);
+void WriteTrace (void);
+
+// MAPFILE.C
+
+#define MAPERROR_SIZE	256
+
+// why the last load or save failed
+#ifdef NOSDL
+extern _Thread_local char	maperror[MAPERROR_SIZE];
+#else
+extern char				maperror[MAPERROR_SIZE];
+#endif
+
+void MapError (const char *format, ...);
+bool AllocMap (int width, int height, int numdims);
+void BuildMapTables (void);
+void UpdateMapTables (int w, int x, int y);
+bool OpenMapFile (const char *name, mapfile_t *mf);
+void CloseMapFile (mapfile_t *mf);
+bool DecodeDimension (mapfile_t *mf, int w, tile_t *dest);
+bool ReadMapFile (const char *name);
+bool WriteMapFile (const char *name);
+
 // EDITOR.C
 
+bool FileExists (const char *name);
 bool Ctrl (void);
 void EditorLoop (void);
 void OpenMap (int number);
+void print (int x, int y, const char *string);
 
 #endif /* labyrinth_h */
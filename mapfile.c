@@ -0,0 +1,471 @@
+//
+//  mapfile.c
+//  Labyrinth
+//
+//  Map file format (all values little-endian):
+//
+//  offset  size
+//  0       4       magic "LABM"
+//  4       2       version
+//  6       2       number of dimensions
+//  8       2       width
+//  10      2       height
+//  12      4       reserved (0)
+//  16      8*dims  directory: offset and length of each dimension's data
+//
+//  Each dimension is width*height tiles of one byte, packed the same way
+//  as tile_t in memory. If its length is less than
+//  width*height, it is run-length encoded as (count, tile) byte pairs.
+//
+//  Legacy files (the raw tile_t map array, no header) are still read.
+//
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "labyrinth.h"
+
+#define MAPFILE_MAGIC		"LABM"
+#define MAPFILE_VERSION		1
+#define MAPFILE_HEADER		16
+#define MAPFILE_DIRENTRY	8
+#define MAX_RUN				255
+
+// tile as stored in the original format: the in-memory map array
+typedef struct
+{
+	int32_t		type;
+	int32_t		id;
+} legacytile_t;
+
+#define LEGACY_DIMS			5
+#define LEGACY_MAPSIZE		64
+#define LEGACY_SIZE			(LEGACY_DIMS * LEGACY_MAPSIZE * LEGACY_MAPSIZE * sizeof(legacytile_t))
+
+#ifdef NOSDL
+_Thread_local char	maperror[MAPERROR_SIZE];
+#else
+char				maperror[MAPERROR_SIZE];
+#endif
+
+
+
+
+//
+// MapError
+// Say why a level could not be loaded or saved, and keep it in maperror.
+// The headless tools print it to stderr, as their output is on stdout.
+//
+void MapError (const char *format, ...)
+{
+	va_list args;
+	
+	va_start(args, format);
+	vsnprintf(maperror, sizeof(maperror), format, args);
+	va_end(args);
+#ifdef NOSDL
+	fprintf(stderr, "%s\n", maperror);
+#else
+	printf("%s\n", maperror);
+#endif
+}
+
+
+
+
+uint16_t Get16 (const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+uint32_t Get32 (const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+void Put16 (uint8_t *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+void Put32 (uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+
+
+
+//
+// AllocMap
+// (Re)allocate the map for the given size. Tiles are left empty;
+// call BuildMapTables once they are filled in.
+//
+bool AllocMap (int width, int height, int numdims)
+{
+	tile_t	*tiles;
+	uint8_t	*gatelinks;
+	uint8_t	*skip;
+	
+	// tiles are indexed with an int
+	if (width < 1 || height < 1 || numdims < 1 || numdims > MAXDIMS
+		|| (size_t)numdims * width * height > INT32_MAX) {
+		MapError("AllocMap: Bad map size %dx%dx%d", width, height, numdims);
+		return false;
+	}
+	tiles = calloc((size_t)numdims * width * height, sizeof(tile_t));
+	gatelinks = calloc((size_t)numdims * width * height, sizeof(uint8_t));
+	skip = calloc((size_t)numdims * width * height, sizeof(uint8_t));
+	if (!tiles || !gatelinks || !skip) {
+		MapError("AllocMap: Out of memory");
+		free(tiles);
+		free(gatelinks);
+		free(skip);
+		return false;
+	}
+	
+	free(map.tiles);
+	free(map.gatelinks);
+	free(map.skip);
+	FreePathGraph(map.paths);
+	map.paths = NULL;
+	map.tiles = tiles;
+	map.gatelinks = gatelinks;
+	map.skip = skip;
+	map.width = width;
+	map.height = height;
+	map.numdims = numdims;
+	return true;
+}
+
+
+
+
+//
+// BuildMapTables
+// Build the gate links, the caster's skip field and the path graph for
+// the whole map
+//
+void BuildMapTables (void)
+{
+	BuildGateLinks();
+	BuildSkipField();
+	BuildPathGraph();
+	map.version++;
+}
+
+
+
+
+//
+// UpdateMapTables
+// Update the gate links, skip field and path graph after tile x, y in
+// dimension w has changed
+//
+void UpdateMapTables (int w, int x, int y)
+{
+	UpdateGateLinks(x, y);
+	UpdateSkipField(w, x, y, x, y);
+	UpdatePathGraph(x, y);
+	map.version++;
+}
+
+
+
+
+//
+// OpenMapFile
+// Map a level file into memory and check its header. Dimensions are
+// decoded one at a time, when needed, with DecodeDimension.
+//
+bool OpenMapFile (const char *name, mapfile_t *mf)
+{
+	int			fd;
+	struct stat	st;
+	uint32_t	w, offset, length;
+	
+	memset(mf, 0, sizeof(*mf));
+	
+	fd = open(name, O_RDONLY);
+	if (fd == -1) {
+		MapError("OpenMapFile: Could not open %s", name);
+		return false;
+	}
+	if (fstat(fd, &st) == -1 || st.st_size < MAPFILE_HEADER) {
+		MapError("OpenMapFile: %s is not a map file", name);
+		close(fd);
+		return false;
+	}
+	
+	mf->size = st.st_size;
+	mf->data = mmap(NULL, mf->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // the mapping stays valid
+	if (mf->data == MAP_FAILED) {
+		MapError("OpenMapFile: Could not map %s", name);
+		mf->data = NULL;
+		return false;
+	}
+	
+	if (memcmp(mf->data, MAPFILE_MAGIC, 4))
+	{
+		if (mf->size != LEGACY_SIZE) {
+			MapError("OpenMapFile: %s is not a map file", name);
+			CloseMapFile(mf);
+			return false;
+		}
+		mf->legacy = true;
+		mf->version = 0;
+		mf->numdims = LEGACY_DIMS;
+		mf->width = LEGACY_MAPSIZE;
+		mf->height = LEGACY_MAPSIZE;
+		return true;
+	}
+	
+	mf->version = Get16(mf->data + 4);
+	mf->numdims = Get16(mf->data + 6);
+	mf->width = Get16(mf->data + 8);
+	mf->height = Get16(mf->data + 10);
+	
+	if (!mf->numdims || mf->numdims > MAXDIMS || !mf->width || !mf->height
+		|| (size_t)mf->numdims * mf->width * mf->height > INT32_MAX) {
+		MapError("OpenMapFile: %s has bad size %dx%dx%d",
+			   name, mf->width, mf->height, mf->numdims);
+		CloseMapFile(mf);
+		return false;
+	}
+	if (mf->version != MAPFILE_VERSION) {
+		MapError("OpenMapFile: %s is version %d, expected %d",
+			   name, mf->version, MAPFILE_VERSION);
+		CloseMapFile(mf);
+		return false;
+	}
+	if (mf->size < MAPFILE_HEADER + mf->numdims * MAPFILE_DIRENTRY) {
+		MapError("OpenMapFile: %s is truncated", name);
+		CloseMapFile(mf);
+		return false;
+	}
+	for (w=0 ; w<mf->numdims ; w++)
+	{
+		offset = Get32(mf->data + MAPFILE_HEADER + w * MAPFILE_DIRENTRY);
+		length = Get32(mf->data + MAPFILE_HEADER + w * MAPFILE_DIRENTRY + 4);
+		if (offset > mf->size || length > mf->size - offset) {
+			MapError("OpenMapFile: %s is truncated", name);
+			CloseMapFile(mf);
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+
+
+
+void CloseMapFile (mapfile_t *mf)
+{
+	if (mf->data)
+		munmap(mf->data, mf->size);
+	mf->data = NULL;
+}
+
+
+
+
+//
+// DecodeDimension
+// Unpack dimension w of an open map file into dest (width*height tiles).
+// Fails if the data is cut short or has a tile type the game doesn't know.
+//
+bool DecodeDimension (mapfile_t *mf, int w, tile_t *dest)
+{
+	const uint8_t	*src, *end;
+	uint32_t		offset, length;
+	int				count, numtiles, i;
+	tile_t			tile;
+	
+	if (w < 0 || w >= mf->numdims)
+		return false;
+	numtiles = mf->width * mf->height;
+	
+	if (mf->legacy)
+	{
+		const legacytile_t *old = (const legacytile_t *)mf->data + w * numtiles;
+		
+		for (i=0 ; i<numtiles ; i++) {
+			if (old[i].type < 0 || old[i].type >= TT_COUNT)
+				return false;
+			dest[i] = MakeTile(old[i].type, old[i].id);
+		}
+		return true;
+	}
+	
+	offset = Get32(mf->data + MAPFILE_HEADER + w * MAPFILE_DIRENTRY);
+	length = Get32(mf->data + MAPFILE_HEADER + w * MAPFILE_DIRENTRY + 4);
+	src = mf->data + offset;
+	end = src + length;
+	
+	if (length == numtiles) // stored
+	{
+		for (i=0 ; i<numtiles ; i++)
+			if (TileType(src[i]) >= TT_COUNT)
+				return false;
+		memcpy(dest, src, numtiles);
+		return true;
+	}
+	
+	// run-length encoded
+	i = 0;
+	while (src + 1 < end)
+	{
+		count = *src++;
+		tile = *src++;
+		if (i + count > numtiles || TileType(tile) >= TT_COUNT)
+			return false;
+		while (count--)
+			dest[i++] = tile;
+	}
+	return src == end && i == numtiles;
+}
+
+
+
+
+//
+// ReadMapFile
+// Load every dimension of level file 'name' into the map, which is
+// resized to fit
+//
+bool ReadMapFile (const char *name)
+{
+	mapfile_t	mf;
+	int			w;
+	
+	if (!OpenMapFile(name, &mf))
+		return false;
+	
+	if (!AllocMap(mf.width, mf.height, mf.numdims)) {
+		CloseMapFile(&mf);
+		return false;
+	}
+	
+	for (w=0 ; w<map.numdims ; w++)
+	{
+		if (!DecodeDimension(&mf, w, &map.tiles[w * map.width * map.height])) {
+			MapError("ReadMapFile: %s dimension %d is corrupt", name, w);
+			CloseMapFile(&mf);
+			return false;
+		}
+	}
+	
+	CloseMapFile(&mf);
+	BuildMapTables();
+	return true;
+}
+
+
+
+
+//
+// EncodeDimension
+// Pack dimension w into buffer (room for 2 * width * height bytes),
+// run-length encoded when that is smaller. Returns the length.
+//
+int EncodeDimension (int w, uint8_t *buffer)
+{
+	int				numtiles = map.width * map.height;
+	const tile_t	*tiles = &map.tiles[w * numtiles];
+	int				i, run, length;
+	
+	length = 0;
+	for (i=0 ; i<numtiles ; i+=run)
+	{
+		for (run=1 ; run<MAX_RUN && i+run<numtiles ; run++)
+			if (tiles[i+run] != tiles[i])
+				break;
+		buffer[length++] = run;
+		buffer[length++] = tiles[i];
+		if (length >= numtiles)
+			break; // not worth it
+	}
+	
+	if (length < numtiles)
+		return length;
+	
+	// doesn't compress: store
+	memcpy(buffer, tiles, numtiles);
+	return numtiles;
+}
+
+
+
+
+//
+// WriteMapFile
+// Save the map to level file 'name'
+//
+bool WriteMapFile (const char *name)
+{
+	FILE		*stream;
+	uint8_t		*header;
+	uint8_t		*data;
+	int			headersize;
+	size_t		dimsize;	// room for one encoded dimension
+	uint32_t	offset;
+	int			length[MAXDIMS];
+	int			w;
+	bool		ok;
+	
+	if (map.width > UINT16_MAX || map.height > UINT16_MAX) {
+		MapError("WriteMapFile: Map is too large to save");
+		return false;
+	}
+	
+	headersize = MAPFILE_HEADER + map.numdims * MAPFILE_DIRENTRY;
+	dimsize = 2 * (size_t)map.width * map.height;
+	header = calloc(headersize, 1);
+	data = malloc(map.numdims * dimsize);
+	if (!header || !data) {
+		MapError("WriteMapFile: Out of memory");
+		free(header);
+		free(data);
+		return false;
+	}
+	
+	memcpy(header, MAPFILE_MAGIC, 4);
+	Put16(header + 4, MAPFILE_VERSION);
+	Put16(header + 6, map.numdims);
+	Put16(header + 8, map.width);
+	Put16(header + 10, map.height);
+	
+	offset = headersize;
+	for (w=0 ; w<map.numdims ; w++)
+	{
+		length[w] = EncodeDimension(w, data + w * dimsize);
+		Put32(header + MAPFILE_HEADER + w * MAPFILE_DIRENTRY, offset);
+		Put32(header + MAPFILE_HEADER + w * MAPFILE_DIRENTRY + 4, length[w]);
+		offset += length[w];
+	}
+	
+	stream = fopen(name, "wb");
+	ok = stream != NULL;
+	if (ok) {
+		ok = fwrite(header, headersize, 1, stream) == 1;
+		for (w=0 ; w<map.numdims && ok ; w++)
+			ok = fwrite(data + w * dimsize, length[w], 1, stream) == 1;
+		ok = fclose(stream) == 0 && ok;
+	}
+	free(header);
+	free(data);
+	
+	if (!ok)
+		MapError("WriteMapFile: Error writing %s", name);
+	return ok;
+}
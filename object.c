@@ -49,207 +49,373 @@ void SetPosition (obj_t *obj, float x, float y)
 
 
 
-tiletype_t CurrentBlockType (obj_t *obj)
-{
-	return map[obj->w][(int)obj->y][(int)obj->x].type;
-}
-
-
-
-
 //
-// GateSide
-// Returns which side of the gate the object is on
-// (should never return SIDE_UNDEFINED, indicates error)
+// GateMatches
+// Returns how many other dimensions have a gate of the same type at x, y
+// as the gate in dimension w. A gate links correctly if this is one.
 //
-side_t GateSide (obj_t *obj)
+int GateMatches (int w, int x, int y)
 {
-	tiletype_t type;
-	int 		x, y; // block coords
-	float 		position;
-	
-	type = CurrentBlockType(obj);
-	x = (int)obj->x;
-	y = (int)obj->y;
-	position = type == TT_GATE_H ? obj->x-(float)x : obj->y-(float)y;
-	
-	if (type == TT_GATE_H)
-		return position < 0.5f ? SIDE_LEFT : SIDE_RIGHT;
-	else if (type == TT_GATE_V)
-		return position < 0.5f ? SIDE_TOP : SIDE_BOTTOM;
-	return SIDE_UNDEFINED;
+	tiletype_t	type;
+	int			other, count;
+	
+	type = MapType(w, x, y);
+	count = 0;
+	for (other=0 ; other<map.numdims ; other++) {
+		if (other != w && MapType(other, x, y) == type)
+			count++;
+	}
+	return count;
 }
 
 
 
 
 //
-// DoGate
-// Obj is in a gate, handle it
+// UpdateGateLinks
+// Recalculate where the gates at x, y lead in every dimension: a gate
+// leads to the first other dimension with a gate of the same type there
+// (the gate's type also gives the axis it is crossed along), anything
+// else leads back to its own dimension. Call whenever a tile changes.
+// Returns the number of gates at x, y that are dangling or ambiguous.
 //
-void DoGate (obj_t *obj)
+int UpdateGateLinks (int x, int y)
 {
-	int w;
+	tiletype_t	type;
+	int			w, dest, bad;
+	size_t		index;
 	
-	if (!obj->ingate) {
-		// just entered a gate
-		obj->ingate = true;
-		obj->entryside = GateSide(obj); // store current side
-	} else {
-		// already in gate: crossed to other side?
-		if (obj->entryside == SIDE_UNDEFINED)
-			Quit("DoGate: GetSide returned SIDE_UNDEFINED");
+	bad = 0;
+	for (w=0 ; w<map.numdims ; w++)
+	{
+		index = ((size_t)w * map.height + y) * map.width + x;
+		map.gatelinks[index] = w;
 		
-		if (GateSide(obj) != obj->entryside) {
-			// crossed to other side
-			for (w=0 ; w<NUMDIMS ; w++) {
-				if (w == obj->w) continue;
-				if (map[w][obj->tiley][obj->tilex].type == CurrentBlockType(obj)) {
-					obj->w = w;
-					break;
-				}
+		type = MapType(w, x, y);
+		if (type != TT_GATE_H && type != TT_GATE_V)
+			continue;
+		
+		if (GateMatches(w, x, y) != 1)
+			bad++;
+		for (dest=0 ; dest<map.numdims ; dest++) {
+			if (dest != w && MapType(dest, x, y) == type) {
+				map.gatelinks[index] = dest;
+				break;
 			}
-			// (in case obj goes back while still in portal)
-			obj->entryside = GateSide(obj);
 		}
 	}
+	return bad;
 }
 
 
 
 
 //
-// CheckBlock
-// Check block obj is currently in and
-// process accordingly
+// BuildGateLinks
+// Link every gate in the map. Call after a map is loaded or created.
+// Returns the number of dangling or ambiguous gates.
 //
-void CheckBlock (obj_t *obj)
+int BuildGateLinks (void)
 {
-	switch (map[obj->w][(int)obj->y][(int)obj->x].type)
-	{
-		// handle passage through a gate
-		case TT_GATE_H:
-		case TT_GATE_V:
-			DoGate(obj);
-			break;
-			
-		default:
-			obj->ingate = false; // in case exited a gate
-			break;
-	}
+	int x, y, bad;
+	
+	bad = 0;
+	for (y=0 ; y<map.height ; y++)
+		for (x=0 ; x<map.width ; x++)
+			bad += UpdateGateLinks(x, y);
+	return bad;
 }
 
 
 
 
+//
+// GateDestination
+// Returns the dimension reached by passing through the gate at x, y
+// in dimension w (w itself if no other dimension has a matching gate)
+//
+int GateDestination (int w, int x, int y)
+{
+	return map.gatelinks[((size_t)w * map.height + y) * map.width + x];
+}
+
+
 
 
-bool TryMove (obj_t *obj)
+//
+// SweepCircle
+// Moving from x, y by xmove, ymove, when does a point first come within
+// 'radius' of cx, cy? Records it in 'contact' if sooner than what is there.
+// Something already that close only stops a move toward it.
+//
+void SweepCircle (float x, float y, float xmove, float ymove,
+				  float cx, float cy, float radius, contact_t *contact)
 {
-	int x1,y1,xh,yh,x,y;
+	float a, b, c, disc, t, len;
 	
-	x1 = (int)(obj->x - obj->r);
-	y1 = (int)(obj->y - obj->r);
-	xh = (int)(obj->x + obj->r);
-	yh = (int)(obj->y + obj->r);
+	x -= cx;
+	y -= cy;
+	a = xmove*xmove + ymove*ymove;
+	b = 2.0f * (x*xmove + y*ymove);
+	c = x*x + y*y - radius*radius;
+	if (b >= 0.0f || a == 0.0f)
+		return; // not getting any closer
 	
-	// check for solid walls
-	for (y=y1 ; y<=yh ; y++)
-		for (x=x1 ; x<=xh ; x++)
-		{
-			if (map[obj->w][y][x].type == TT_WALL)
-				return false;
-		}
-	
-	// TODO check for actors
+	if (c < 0.0f) {
+		t = 0.0f; // already touching
+	} else {
+		disc = b*b - 4.0f*a*c;
+		if (disc < 0.0f)
+			return;
+		t = (-b - sqrtf(disc)) / (2.0f * a);
+	}
+	if (t >= contact->t)
+		return;
 	
-	return true;
+	x += xmove * t;
+	y += ymove * t;
+	len = sqrtf(x*x + y*y);
+	contact->t = t;
+	contact->nx = len > 0.0f ? x / len : 0.0f;
+	contact->ny = len > 0.0f ? y / len : 0.0f;
 }
 
 
 
-void ClipMove (obj_t *obj, float xmove, float ymove)
+
+//
+// SweepTile
+// Sweep a circle of radius r against the solid tile tx, ty: the circle
+// touches the tile when its center enters the tile grown by r, which is
+// two rectangles and four corner circles
+//
+void SweepTile (float x, float y, float r, float xmove, float ymove,
+				int tx, int ty, contact_t *contact)
 {
-	float basex, basey;
-	
-	basex = obj->x;
-	basey = obj->y;
-	
-	obj->x = basex + xmove;
-	obj->y = basey + ymove;
-	if (TryMove(obj))
-		return;
-	
-	obj->x = basex + xmove;
-	obj->y = basey;
-	if (TryMove(obj))
-		return;
+	float t, cross, face;
 	
-	obj->x = basex;
-	obj->y = basey + ymove;
-	if (TryMove(obj))
-		return;
+	// faces: a center already a little way in from the face it's moving
+	// toward (from rounding) touches it now
+	if (xmove != 0.0f)
+	{
+		face = xmove > 0.0f ? tx - r : tx + 1 + r;
+		t = (face - x) / xmove;
+		if (t < 0.0f && fabsf(x - face) < r)
+			t = 0.0f;
+		cross = y + ymove * t;
+		if (t >= 0.0f && t < contact->t && cross >= ty && cross <= ty + 1) {
+			contact->t = t;
+			contact->nx = xmove > 0.0f ? -1.0f : 1.0f;
+			contact->ny = 0.0f;
+		}
+	}
+	if (ymove != 0.0f)
+	{
+		face = ymove > 0.0f ? ty - r : ty + 1 + r;
+		t = (face - y) / ymove;
+		if (t < 0.0f && fabsf(y - face) < r)
+			t = 0.0f;
+		cross = x + xmove * t;
+		if (t >= 0.0f && t < contact->t && cross >= tx && cross <= tx + 1) {
+			contact->t = t;
+			contact->nx = 0.0f;
+			contact->ny = ymove > 0.0f ? -1.0f : 1.0f;
+		}
+	}
 	
-	obj->x = basex;
-	obj->y = basey;
+	// corners
+	SweepCircle(x, y, xmove, ymove, tx, ty, r, contact);
+	SweepCircle(x, y, xmove, ymove, tx + 1, ty, r, contact);
+	SweepCircle(x, y, xmove, ymove, tx, ty + 1, r, contact);
+	SweepCircle(x, y, xmove, ymove, tx + 1, ty + 1, r, contact);
 }
 
 
 
 
-
-void Thrust (float angle, float speed)
+//
+// SweepWalls
+// Sweep a circle of radius r in dimension w against every wall it could
+// reach (outside the map counts as solid)
+//
+void SweepWalls (int w, float x, float y, float r, float xmove, float ymove,
+				 contact_t *contact)
 {
-	float xmove, ymove;
-		
-	xmove = speed * cosf(angle);
-	ymove = -speed * sinf(angle);
-
-	player.oldx = player.x;
-	player.oldy = player.y;
-	player.tilex = (int)player.x;
-	player.tiley = (int)player.y;
+	int x1, y1, x2, y2, tx, ty;
 	
-	ClipMove(&player, xmove, ymove);
+	x1 = (int)floorf(fminf(x, x + xmove) - r);
+	y1 = (int)floorf(fminf(y, y + ymove) - r);
+	x2 = (int)floorf(fmaxf(x, x + xmove) + r);
+	y2 = (int)floorf(fmaxf(y, y + ymove) + r);
+	bound(x1, -1, map.width);
+	bound(y1, -1, map.height);
+	bound(x2, -1, map.width);
+	bound(y2, -1, map.height);
+	
+	for (ty=y1 ; ty<=y2 ; ty++)
+		for (tx=x1 ; tx<=x2 ; tx++)
+			if (!InMap(tx, ty) || MapType(w, tx, ty) == TT_WALL)
+				SweepTile(x, y, r, xmove, ymove, tx, ty, contact);
 }
 
 
 
 
-void ControlMovement (obj_t *obj)
+//
+// SweepGates
+// Find the first gate center line crossed moving from x, y by xmove, ymove
+// by fraction 'limit' of the move. That is where a gate switches
+// dimension. A center exactly on a line is on its low (left or top) side,
+// so a move that ends on a line and one that starts there agree about
+// whether it was crossed. Returns false if there is none, else sets *t
+// and the tile.
+//
+bool SweepGates (int w, float x, float y, float xmove, float ymove,
+				 float limit, float *t, int *gatex, int *gatey)
 {
-	float angle;
+	int		line, last, tx, ty;
+	float	cross;
+	bool	found;
 	
-	//
-	// forwards/backwards
-	//
-	if (obj->dy > 0)
-	{
-		angle = obj->angle + ANG90;
-		if (angle < 0)
-			angle += ANGLES;
-		Thrust (angle,obj->dy);
-	}
-	else if (obj->dy < 0)
+	found = false;
+	*t = limit;
+	
+	// lines through the middle of each column of tiles, for TT_GATE_H
+	if (xmove != 0.0f)
 	{
-		angle = obj->angle - ANG90;
-		if (angle >= ANGLES)
-			angle -= ANGLES;
-		Thrust (angle,-obj->dy);
+		line = (int)ceilf(x - 0.5f) - (xmove < 0.0f);
+		last = (int)ceilf(x + xmove - 0.5f) - (xmove < 0.0f);
+		for ( ; xmove > 0.0f ? line < last : line > last ; line += xmove > 0.0f ? 1 : -1)
+		{
+			cross = (line + 0.5f - x) / xmove;
+			if (cross > *t)
+				break;
+			tx = line;
+			ty = (int)floorf(y + ymove * cross);
+			if (InMap(tx, ty) && MapType(w, tx, ty) == TT_GATE_H) {
+				*t = cross;
+				*gatex = tx;
+				*gatey = ty;
+				found = true;
+				break;
+			}
+		}
 	}
 	
-	//
-	// strafe
-	//
-	if (obj->dx < 0)
+	// and through the middle of each row, for TT_GATE_V
+	if (ymove != 0.0f)
 	{
-		Thrust (obj->angle,-obj->dx); // strafe left
+		line = (int)ceilf(y - 0.5f) - (ymove < 0.0f);
+		last = (int)ceilf(y + ymove - 0.5f) - (ymove < 0.0f);
+		for ( ; ymove > 0.0f ? line < last : line > last ; line += ymove > 0.0f ? 1 : -1)
+		{
+			cross = (line + 0.5f - y) / ymove;
+			if (cross > *t)
+				break;
+			tx = (int)floorf(x + xmove * cross);
+			ty = line;
+			if (InMap(tx, ty) && MapType(w, tx, ty) == TT_GATE_V) {
+				*t = cross;
+				*gatex = tx;
+				*gatey = ty;
+				found = true;
+				break;
+			}
+		}
 	}
-	else if (obj->dx > 0)
+	
+	return found;
+}
+
+
+
+
+//
+// SlideMove
+// Move a circle of radius r at *x, *y in dimension *w by xmove, ymove in
+// one continuous sweep, so nothing is skipped however fast it goes. When
+// it runs into a wall or another object it slides along it with what is
+// left of the move. Crossing a gate's center line switches *w there, and
+// the rest of the move is swept in the new dimension. 'actor' is the
+// index of the actor being moved, or -1 for the player.
+//
+void SlideMove (int *w, float *x, float *y, float r, float xmove, float ymove,
+				int actor)
+{
+	contact_t	contact;
+	int			pass, gatex, gatey;
+	float		t, into;
+	
+	for (pass=0 ; pass<SLIDE_PASSES ; pass++)
 	{
-		angle = obj->angle + ANGLES/2;
-		if (angle >= ANGLES)
-			angle -= ANGLES;
-		Thrust (angle,obj->dx);		// strafe right
+		if (xmove == 0.0f && ymove == 0.0f)
+			break;
+		
+		contact.t = 1.0f;
+		contact.nx = contact.ny = 0.0f;
+		SweepWalls(*w, *x, *y, r, xmove, ymove, &contact);
+		SweepActors(*w, *x, *y, r, xmove, ymove, actor, &contact);
+		if (actor != -1 && player.w == *w)
+			SweepCircle(*x, *y, xmove, ymove, player.x, player.y, r + player.r, &contact);
+		
+		if (SweepGates(*w, *x, *y, xmove, ymove, contact.t, &t, &gatex, &gatey))
+		{
+			// through the gate, keep going on the other side. The center
+			// is put on the side of the line it crossed to: on the line
+			// itself is the low side, so just past it for the high side.
+			*x += xmove * t;
+			*y += ymove * t;
+			if (MapType(*w, gatex, gatey) == TT_GATE_H)
+				*x = xmove > 0.0f ? nextafterf(gatex + 0.5f, INFINITY) : gatex + 0.5f;
+			else
+				*y = ymove > 0.0f ? nextafterf(gatey + 0.5f, INFINITY) : gatey + 0.5f;
+			*w = GateDestination(*w, gatex, gatey);
+			xmove *= 1.0f - t;
+			ymove *= 1.0f - t;
+			continue;
+		}
+		
+		if (contact.t == 1.0f) {
+			*x += xmove;
+			*y += ymove;
+			break;
+		}
+		
+		// stop a little short of the surface, and slide along it
+		t = contact.t - SLIDE_GAP / sqrtf(xmove*xmove + ymove*ymove);
+		if (t > 0.0f) {
+			*x += xmove * t;
+			*y += ymove * t;
+		}
+		xmove *= 1.0f - contact.t;
+		ymove *= 1.0f - contact.t;
+		into = xmove * contact.nx + ymove * contact.ny;
+		xmove -= into * contact.nx;
+		ymove -= into * contact.ny;
 	}
 }
+
+
+
+
+//
+// ControlMovement
+// Move obj by its forward (dy) and strafe (dx) speeds for one tick
+//
+void ControlMovement (obj_t *obj)
+{
+	float xmove, ymove;
+	
+	if (obj->dx == 0.0f && obj->dy == 0.0f)
+		return;
+	
+	// negative dy is forward, along (sin, cos); negative dx is left
+	xmove = -obj->dy * obj->sin - obj->dx * obj->cos;
+	ymove = -obj->dy * obj->cos + obj->dx * obj->sin;
+	
+	obj->oldx = obj->x;
+	obj->oldy = obj->y;
+	SlideMove(&obj->w, &obj->x, &obj->y, obj->r, xmove, ymove, -1);
+	obj->tilex = (int)obj->x;
+	obj->tiley = (int)obj->y;
+}
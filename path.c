@@ -0,0 +1,822 @@
+//
+//  path.c
+//  Labyrinth
+//
+//  Pathfinding through the map and its gates. Each dimension is cut into
+//  clusters of PATH_CLUSTER x PATH_CLUSTER tiles, and the open tiles of a
+//  cluster into regions: tiles that connect without leaving the cluster.
+//  Regions are linked where they touch across a cluster's edge and where a
+//  gate leads into another dimension. A query searches the region graph
+//  first, then searches tiles only inside the regions it found.
+//
+//  The graph is built when a map is loaded. An edit only marks the
+//  clusters at that spot, which are rebuilt before the next query.
+//  Queries on one map must not run at the same time.
+//
+//  Paths step between 4-connected tiles. A gate tile is two nodes, one
+//  for each side of its center line (left and right for TT_GATE_H, top
+//  and bottom for TT_GATE_V), since crossing the line is what moves an
+//  object to another dimension (see SlideMove).
+//
+
+#include <math.h>
+#include <string.h>
+
+#include "labyrinth.h"
+
+// cluster needs rebuilding
+#define PD_REGIONS		1
+#define PD_EDGES		2
+
+#define MAX_NEIGHBORS	9	// four directions, two sides each way into a
+							// gate, and through a gate's line
+
+typedef struct
+{
+	int		region;		// region id, see RegionId
+	float	cost;
+} pathedge_t;
+
+typedef struct
+{
+	float		x, y;		// middle of its tiles
+	int			numedges;
+	int			maxedges;
+	pathedge_t	*edges;
+	
+	// search state, valid when search is the graph's search
+	unsigned	search;
+	float		g;
+	int			parent;		// region id searched from, -1 at the start
+	unsigned	corridor;	// on the search's region path
+} pathregion_t;
+
+typedef struct
+{
+	int				numregions;
+	pathregion_t	*regions;
+	int				dirty;		// PD_ flags
+} pathcluster_t;
+
+// open list entry, for both searches
+typedef struct
+{
+	float	key;
+	int		id;
+} pathopen_t;
+
+typedef struct pathgraph_s
+{
+	int				cwidth, cheight;	// clusters across and down a dimension
+	int				numclusters;
+	pathcluster_t	*clusters;
+	bool			dirty;				// some cluster needs rebuilding
+	
+	int				numnodes;
+	int				*noderegion;		// per node: region id, -1 if none
+	
+	// search state
+	unsigned		search;
+	unsigned		*nodesearch;		// node's g and parent are valid
+	int				*nodeg;
+	int				*nodeparent;
+	int				numopen;
+	int				maxopen;
+	pathopen_t		*open;
+} pathgraph_t;
+
+const int pathdirs[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+
+
+
+
+//
+// NodeIndex
+// A path node: tile x, y in dimension w, and for a gate which side of its
+// center line (0 for the left or top)
+//
+int NodeIndex (int w, int x, int y, int side)
+{
+	return (((w * map.height + y) * map.width + x) << 1) | side;
+}
+
+
+
+
+void NodeTile (int node, int *w, int *x, int *y)
+{
+	int tile = node >> 1;
+	
+	*x = tile % map.width;
+	*y = tile / map.width % map.height;
+	*w = tile / map.width / map.height;
+}
+
+
+
+
+int ClusterIndex (pathgraph_t *graph, int w, int x, int y)
+{
+	return (w * graph->cheight + y / PATH_CLUSTER) * graph->cwidth + x / PATH_CLUSTER;
+}
+
+
+
+
+//
+// RegionId
+// Regions are numbered by cluster, so a cluster can be rebuilt without
+// renumbering the others
+//
+int RegionId (int cluster, int region)
+{
+	return cluster * PATH_REGIONS + region;
+}
+
+
+
+
+pathregion_t *Region (pathgraph_t *graph, int id)
+{
+	return &graph->clusters[id / PATH_REGIONS].regions[id % PATH_REGIONS];
+}
+
+
+
+
+bool IsGate (tiletype_t type)
+{
+	return type == TT_GATE_H || type == TT_GATE_V;
+}
+
+
+
+
+//
+// NodeNeighbors
+// Fill 'next' with the nodes one step from 'node' and return how many.
+// Moving along a gate's axis enters it on the near side and leaves it
+// from the far side; moving across it can use either side. Crossing the
+// center line leads to the other side in the gate's destination.
+//
+int NodeNeighbors (int node, int *next)
+{
+	int			w, x, y, side;
+	int			d, dx, dy, nx, ny, count;
+	int			neighbor;
+	tiletype_t	type, ntype;
+	
+	NodeTile(node, &w, &x, &y);
+	side = node & 1;
+	type = MapType(w, x, y);
+	count = 0;
+	
+	for (d=0 ; d<4 ; d++)
+	{
+		dx = pathdirs[d][0];
+		dy = pathdirs[d][1];
+		if (((type == TT_GATE_H && !dy) || (type == TT_GATE_V && !dx))
+			&& side != (dx + dy > 0))
+			continue;
+		
+		nx = x + dx;
+		ny = y + dy;
+		if (!InMap(nx, ny) || (ntype = MapType(w, nx, ny)) == TT_WALL)
+			continue;
+		
+		neighbor = NodeIndex(w, nx, ny, 0);
+		if ((ntype == TT_GATE_H && !dy) || (ntype == TT_GATE_V && !dx)) {
+			next[count++] = neighbor | (dx + dy < 0);
+		} else {
+			next[count++] = neighbor;
+			if (IsGate(ntype))
+				next[count++] = neighbor | 1;
+		}
+	}
+	
+	if (IsGate(type))
+		next[count++] = NodeIndex(GateDestination(w, x, y), x, y, !side);
+	
+	return count;
+}
+
+
+
+
+//
+// NodeOpen
+// Is node a place a path can go: an open tile, and for side 1 a gate
+//
+bool NodeOpen (int w, int x, int y, int side)
+{
+	tiletype_t type = MapType(w, x, y);
+	
+	return type != TT_WALL && (!side || IsGate(type));
+}
+
+
+
+
+void FreeRegions (pathcluster_t *cluster)
+{
+	int i;
+	
+	for (i=0 ; i<cluster->numregions ; i++)
+		free(cluster->regions[i].edges);
+	free(cluster->regions);
+	cluster->regions = NULL;
+	cluster->numregions = 0;
+}
+
+
+
+
+//
+// BuildRegions
+// Flood fill the nodes of a cluster into regions
+//
+void BuildRegions (pathgraph_t *graph, int c)
+{
+	pathcluster_t	*cluster = &graph->clusters[c];
+	pathregion_t	*region;
+	int				stack[PATH_REGIONS];
+	int				next[MAX_NEIGHBORS];
+	float			sumx[PATH_REGIONS], sumy[PATH_REGIONS];
+	int				size[PATH_REGIONS];
+	int				w, x1, y1, x2, y2, x, y, side;
+	int				nw, nx, ny, node, count, top, i;
+	int				id;
+	
+	FreeRegions(cluster);
+	w = c / (graph->cwidth * graph->cheight);
+	x1 = c % graph->cwidth * PATH_CLUSTER;
+	y1 = c / graph->cwidth % graph->cheight * PATH_CLUSTER;
+	x2 = x1 + PATH_CLUSTER;
+	y2 = y1 + PATH_CLUSTER;
+	bound(x2, 0, map.width);
+	bound(y2, 0, map.height);
+	
+	for (y=y1 ; y<y2 ; y++)
+		for (x=x1 ; x<x2 ; x++)
+			for (side=0 ; side<2 ; side++)
+				graph->noderegion[NodeIndex(w, x, y, side)] = -1;
+	
+	for (y=y1 ; y<y2 ; y++)
+		for (x=x1 ; x<x2 ; x++)
+			for (side=0 ; side<2 ; side++)
+			{
+				node = NodeIndex(w, x, y, side);
+				if (!NodeOpen(w, x, y, side) || graph->noderegion[node] != -1)
+					continue;
+				
+				id = cluster->numregions++;
+				sumx[id] = sumy[id] = 0;
+				size[id] = 0;
+				graph->noderegion[node] = RegionId(c, id);
+				stack[0] = node;
+				top = 1;
+				while (top)
+				{
+					node = stack[--top];
+					NodeTile(node, &nw, &nx, &ny);
+					sumx[id] += nx;
+					sumy[id] += ny;
+					size[id]++;
+					
+					count = NodeNeighbors(node, next);
+					for (i=0 ; i<count ; i++)
+					{
+						NodeTile(next[i], &nw, &nx, &ny);
+						if (nw != w || nx < x1 || nx >= x2 || ny < y1 || ny >= y2
+							|| graph->noderegion[next[i]] != -1)
+							continue;
+						graph->noderegion[next[i]] = RegionId(c, id);
+						stack[top++] = next[i];
+					}
+				}
+			}
+	
+	if (!cluster->numregions)
+		return;
+	cluster->regions = calloc(cluster->numregions, sizeof(pathregion_t));
+	if (!cluster->regions)
+		Quit("BuildRegions: Out of memory");
+	for (i=0 ; i<cluster->numregions ; i++)
+	{
+		region = &cluster->regions[i];
+		region->x = sumx[i] / size[i] + 0.5f;
+		region->y = sumy[i] / size[i] + 0.5f;
+	}
+}
+
+
+
+
+void AddEdge (pathgraph_t *graph, pathregion_t *region, int to)
+{
+	pathregion_t	*dest;
+	pathedge_t		*edges;
+	int				i;
+	
+	for (i=0 ; i<region->numedges ; i++)
+		if (region->edges[i].region == to)
+			return;
+	
+	if (region->numedges == region->maxedges)
+	{
+		region->maxedges = region->maxedges ? region->maxedges * 2 : 4;
+		edges = realloc(region->edges, region->maxedges * sizeof(pathedge_t));
+		if (!edges)
+			Quit("AddEdge: Out of memory");
+		region->edges = edges;
+	}
+	
+	dest = Region(graph, to);
+	region->edges[region->numedges].region = to;
+	region->edges[region->numedges].cost = hypotf(dest->x - region->x, dest->y - region->y);
+	region->numedges++;
+}
+
+
+
+
+//
+// BuildEdges
+// Link a cluster's regions to the regions they lead into: across the
+// cluster's edges and through gates. The other clusters' regions must be
+// up to date.
+//
+void BuildEdges (pathgraph_t *graph, int c)
+{
+	pathcluster_t	*cluster = &graph->clusters[c];
+	int				next[MAX_NEIGHBORS];
+	int				w, x1, y1, x2, y2, x, y, side;
+	int				node, from, count, i;
+	
+	for (i=0 ; i<cluster->numregions ; i++)
+		cluster->regions[i].numedges = 0;
+	
+	w = c / (graph->cwidth * graph->cheight);
+	x1 = c % graph->cwidth * PATH_CLUSTER;
+	y1 = c / graph->cwidth % graph->cheight * PATH_CLUSTER;
+	x2 = x1 + PATH_CLUSTER;
+	y2 = y1 + PATH_CLUSTER;
+	bound(x2, 0, map.width);
+	bound(y2, 0, map.height);
+	
+	for (y=y1 ; y<y2 ; y++)
+		for (x=x1 ; x<x2 ; x++)
+			for (side=0 ; side<2 ; side++)
+			{
+				node = NodeIndex(w, x, y, side);
+				from = graph->noderegion[node];
+				if (from == -1)
+					continue;
+				
+				count = NodeNeighbors(node, next);
+				for (i=0 ; i<count ; i++)
+					if (graph->noderegion[next[i]] / PATH_REGIONS != c)
+						AddEdge(graph, Region(graph, from), graph->noderegion[next[i]]);
+			}
+}
+
+
+
+
+//
+// RefreshPathGraph
+// Rebuild the clusters edits have marked
+//
+void RefreshPathGraph (pathgraph_t *graph)
+{
+	int c;
+	
+	for (c=0 ; c<graph->numclusters ; c++)
+		if (graph->clusters[c].dirty & PD_REGIONS)
+			BuildRegions(graph, c);
+	for (c=0 ; c<graph->numclusters ; c++)
+	{
+		if (graph->clusters[c].dirty & PD_EDGES)
+			BuildEdges(graph, c);
+		graph->clusters[c].dirty = 0;
+	}
+	graph->dirty = false;
+}
+
+
+
+
+void FreePathGraph (pathgraph_t *graph)
+{
+	int c;
+	
+	if (!graph)
+		return;
+	for (c=0 ; c<graph->numclusters ; c++)
+		FreeRegions(&graph->clusters[c]);
+	free(graph->clusters);
+	free(graph->noderegion);
+	free(graph->nodesearch);
+	free(graph->nodeg);
+	free(graph->nodeparent);
+	free(graph->open);
+	free(graph);
+}
+
+
+
+
+//
+// BuildPathGraph
+// Build the region graph for the whole map. Called by BuildMapTables.
+//
+void BuildPathGraph (void)
+{
+	pathgraph_t	*graph;
+	size_t		numnodes;
+	int			c;
+	
+	FreePathGraph(map.paths);
+	map.paths = NULL;
+	
+	numnodes = (size_t)map.numdims * map.width * map.height * 2;
+	if (numnodes > INT32_MAX / 2) {
+		MapError("BuildPathGraph: Map too large for paths");
+		return;
+	}
+	
+	graph = calloc(1, sizeof(pathgraph_t));
+	if (!graph)
+		Quit("BuildPathGraph: Out of memory");
+	graph->cwidth = (map.width + PATH_CLUSTER - 1) / PATH_CLUSTER;
+	graph->cheight = (map.height + PATH_CLUSTER - 1) / PATH_CLUSTER;
+	graph->numclusters = map.numdims * graph->cwidth * graph->cheight;
+	graph->numnodes = (int)numnodes;
+	graph->clusters = calloc(graph->numclusters, sizeof(pathcluster_t));
+	graph->noderegion = malloc(numnodes * sizeof(int));
+	graph->nodesearch = calloc(numnodes, sizeof(unsigned));
+	graph->nodeg = malloc(numnodes * sizeof(int));
+	graph->nodeparent = malloc(numnodes * sizeof(int));
+	if (!graph->clusters || !graph->noderegion || !graph->nodesearch
+		|| !graph->nodeg || !graph->nodeparent)
+		Quit("BuildPathGraph: Out of memory");
+	
+	for (c=0 ; c<graph->numclusters ; c++)
+		graph->clusters[c].dirty = PD_REGIONS | PD_EDGES;
+	RefreshPathGraph(graph);
+	map.paths = graph;
+}
+
+
+
+
+//
+// UpdatePathGraph
+// Mark the clusters affected by a change to tile x, y in any dimension.
+// Gates at x, y in every dimension may link differently now, so the
+// cluster there is redone in each, along with the edges of its neighbors.
+//
+void UpdatePathGraph (int x, int y)
+{
+	pathgraph_t	*graph = map.paths;
+	int			d, i, cx, cy, nx, ny;
+	
+	if (!graph)
+		return;
+	
+	// by cluster: the last row and column of clusters can be narrower
+	cx = x / PATH_CLUSTER;
+	cy = y / PATH_CLUSTER;
+	for (d=0 ; d<map.numdims ; d++)
+	{
+		graph->clusters[ClusterIndex(graph, d, x, y)].dirty = PD_REGIONS | PD_EDGES;
+		for (i=0 ; i<4 ; i++)
+		{
+			nx = cx + pathdirs[i][0];
+			ny = cy + pathdirs[i][1];
+			if (nx >= 0 && nx < graph->cwidth && ny >= 0 && ny < graph->cheight)
+				graph->clusters[ClusterIndex(graph, d, nx * PATH_CLUSTER, ny * PATH_CLUSTER)].dirty
+					|= PD_EDGES;
+		}
+	}
+	graph->dirty = true;
+}
+
+
+
+
+void PushOpen (pathgraph_t *graph, float key, int id)
+{
+	pathopen_t	*open;
+	int			i, parent;
+	
+	if (graph->numopen == graph->maxopen)
+	{
+		graph->maxopen = graph->maxopen ? graph->maxopen * 2 : 256;
+		open = realloc(graph->open, graph->maxopen * sizeof(pathopen_t));
+		if (!open)
+			Quit("PushOpen: Out of memory");
+		graph->open = open;
+	}
+	
+	open = graph->open;
+	for (i=graph->numopen++ ; i > 0 ; i=parent)
+	{
+		parent = (i - 1) / 2;
+		if (open[parent].key <= key)
+			break;
+		open[i] = open[parent];
+	}
+	open[i].key = key;
+	open[i].id = id;
+}
+
+
+
+
+pathopen_t PopOpen (pathgraph_t *graph)
+{
+	pathopen_t	*open = graph->open;
+	pathopen_t	top, last;
+	int			i, child;
+	
+	top = open[0];
+	last = open[--graph->numopen];
+	for (i=0 ; (child = i * 2 + 1) < graph->numopen ; i=child)
+	{
+		if (child + 1 < graph->numopen && open[child + 1].key < open[child].key)
+			child++;
+		if (last.key <= open[child].key)
+			break;
+		open[i] = open[child];
+	}
+	open[i] = last;
+	return top;
+}
+
+
+
+
+//
+// StartSearch
+// Check the ends of a query and get the graph up to date. Returns false
+// if either end is not an open tile.
+//
+bool StartSearch (pathgraph_t *graph, int w, int x, int y, int goalw, int goalx, int goaly)
+{
+	if (!graph)
+		return false;
+	if (w < 0 || w >= map.numdims || !InMap(x, y) || MapType(w, x, y) == TT_WALL)
+		return false;
+	if (goalw < 0 || goalw >= map.numdims || !InMap(goalx, goaly)
+		|| MapType(goalw, goalx, goaly) == TT_WALL)
+		return false;
+	
+	if (graph->dirty)
+		RefreshPathGraph(graph);
+	graph->search++;
+	graph->numopen = 0;
+	return true;
+}
+
+
+
+
+//
+// SearchRegions
+// A* over the region graph from the regions at w, x, y to those at the
+// goal tile. Marks the regions on the path found as its corridor.
+//
+bool SearchRegions (pathgraph_t *graph, int w, int x, int y, int goalw, int goalx, int goaly)
+{
+	pathregion_t	*region, *next;
+	pathopen_t		open;
+	int				goal[2], side, i, id;
+	float			g, h;
+	
+	goal[0] = graph->noderegion[NodeIndex(goalw, goalx, goaly, 0)];
+	goal[1] = graph->noderegion[NodeIndex(goalw, goalx, goaly, 1)];
+	
+	for (side=0 ; side<2 ; side++)
+	{
+		id = graph->noderegion[NodeIndex(w, x, y, side)];
+		if (id == -1)
+			continue;
+		region = Region(graph, id);
+		region->search = graph->search;
+		region->g = 0;
+		region->parent = -1;
+		PushOpen(graph, hypotf(goalx + 0.5f - region->x, goaly + 0.5f - region->y), id);
+	}
+	
+	while (graph->numopen)
+	{
+		open = PopOpen(graph);
+		region = Region(graph, open.id);
+		h = hypotf(goalx + 0.5f - region->x, goaly + 0.5f - region->y);
+		if (open.key > region->g + h)
+			continue; // found a shorter way here since
+		
+		if (open.id == goal[0] || open.id == goal[1])
+		{
+			for (id=open.id ; id!=-1 ; id=Region(graph, id)->parent)
+				Region(graph, id)->corridor = graph->search;
+			return true;
+		}
+		
+		for (i=0 ; i<region->numedges ; i++)
+		{
+			next = Region(graph, region->edges[i].region);
+			g = region->g + region->edges[i].cost;
+			if (next->search == graph->search && next->g <= g)
+				continue;
+			next->search = graph->search;
+			next->g = g;
+			next->parent = open.id;
+			PushOpen(graph, g + hypotf(goalx + 0.5f - next->x, goaly + 0.5f - next->y),
+					 region->edges[i].region);
+		}
+	}
+	
+	return false;
+}
+
+
+
+
+//
+// PathReachable
+// Can a path get from tile x, y in dimension w to the goal tile? Only
+// searches the region graph, so it is cheaper than FindPath.
+//
+bool PathReachable (int w, int x, int y, int goalw, int goalx, int goaly)
+{
+	pathgraph_t *graph = map.paths;
+	
+	if (!StartSearch(graph, w, x, y, goalw, goalx, goaly))
+		return false;
+	return SearchRegions(graph, w, x, y, goalw, goalx, goaly);
+}
+
+
+
+
+//
+// MarkReachable
+// Flag every tile a path can reach from tile x, y in dimension w: one
+// byte per tile, indexed like the map's tiles. Returns how many there are.
+//
+int MarkReachable (int w, int x, int y, uint8_t *reached)
+{
+	pathgraph_t		*graph = map.paths;
+	pathregion_t	*region, *next;
+	size_t			tile, numtiles;
+	int				side, id, i, count;
+	
+	numtiles = (size_t)map.numdims * map.width * map.height;
+	memset(reached, 0, numtiles);
+	if (!StartSearch(graph, w, x, y, w, x, y))
+		return 0;
+	
+	// flood the region graph, in no particular order
+	for (side=0 ; side<2 ; side++)
+	{
+		id = graph->noderegion[NodeIndex(w, x, y, side)];
+		if (id == -1 || Region(graph, id)->search == graph->search)
+			continue;
+		Region(graph, id)->search = graph->search;
+		PushOpen(graph, 0, id);
+	}
+	while (graph->numopen)
+	{
+		region = Region(graph, PopOpen(graph).id);
+		for (i=0 ; i<region->numedges ; i++)
+		{
+			next = Region(graph, region->edges[i].region);
+			if (next->search == graph->search)
+				continue;
+			next->search = graph->search;
+			PushOpen(graph, 0, region->edges[i].region);
+		}
+	}
+	
+	count = 0;
+	for (tile=0 ; tile<numtiles ; tile++)
+		for (side=0 ; side<2 ; side++)
+		{
+			id = graph->noderegion[tile << 1 | side];
+			if (id != -1 && Region(graph, id)->search == graph->search) {
+				reached[tile] = 1;
+				count++;
+				break;
+			}
+		}
+	
+	return count;
+}
+
+
+
+
+//
+// FindPath
+// Find a path from tile x, y in dimension w to the goal tile, through
+// gates where needed. Fills in up to maxsteps tiles of it, from the start
+// to the goal; a step to another dimension stays on the gate's tile.
+// Returns the number of steps in the whole path, or -1 if there is none.
+//
+int FindPath (int w, int x, int y, int goalw, int goalx, int goaly,
+			  pathstep_t *path, int maxsteps)
+{
+	pathgraph_t	*graph = map.paths;
+	pathopen_t	open;
+	int			next[MAX_NEIGHBORS];
+	int			node, side, count, length, g, h, i;
+	int			nw, nx, ny, tx, ty;
+	int			lastw, lastx, lasty;
+	
+	if (!StartSearch(graph, w, x, y, goalw, goalx, goaly))
+		return -1;
+	if (!SearchRegions(graph, w, x, y, goalw, goalx, goaly))
+		return -1;
+	
+	// A* over the tiles of the corridor the region search found, ties
+	// going to whichever is nearer the goal
+	graph->numopen = 0;
+	for (side=0 ; side<2 ; side++)
+	{
+		node = NodeIndex(w, x, y, side);
+		if (graph->noderegion[node] == -1)
+			continue;
+		graph->nodesearch[node] = graph->search;
+		graph->nodeg[node] = 0;
+		graph->nodeparent[node] = -1;
+		h = abs(goalx - x) + abs(goaly - y);
+		PushOpen(graph, h + h / 4096.0f, node);
+	}
+	
+	node = -1;
+	while (graph->numopen)
+	{
+		open = PopOpen(graph);
+		NodeTile(open.id, &nw, &nx, &ny);
+		h = abs(goalx - nx) + abs(goaly - ny);
+		if (open.key > graph->nodeg[open.id] + h + h / 4096.0f)
+			continue;
+		if (nw == goalw && !h) {
+			node = open.id;
+			break;
+		}
+		
+		count = NodeNeighbors(open.id, next);
+		for (i=0 ; i<count ; i++)
+		{
+			if (Region(graph, graph->noderegion[next[i]])->corridor != graph->search)
+				continue;
+			NodeTile(next[i], &nw, &tx, &ty);
+			g = graph->nodeg[open.id] + (tx != nx || ty != ny);
+			if (graph->nodesearch[next[i]] == graph->search && graph->nodeg[next[i]] <= g)
+				continue;
+			graph->nodesearch[next[i]] = graph->search;
+			graph->nodeg[next[i]] = g;
+			graph->nodeparent[next[i]] = open.id;
+			h = abs(goalx - tx) + abs(goaly - ty);
+			PushOpen(graph, g + h + h / 4096.0f, next[i]);
+		}
+	}
+	if (node == -1)
+		return -1; // can't happen: the corridor connects
+	
+	// count the steps, leaving out moves between the sides of a tile
+	length = 0;
+	lastw = lastx = lasty = -1;
+	for (i=node ; i!=-1 ; i=graph->nodeparent[i])
+	{
+		NodeTile(i, &nw, &nx, &ny);
+		if (nw != lastw || nx != lastx || ny != lasty)
+			length++;
+		lastw = nw;
+		lastx = nx;
+		lasty = ny;
+	}
+	
+	// and fill them in from the goal back
+	count = length;
+	lastw = lastx = lasty = -1;
+	for (i=node ; i!=-1 ; i=graph->nodeparent[i])
+	{
+		NodeTile(i, &nw, &nx, &ny);
+		if (nw == lastw && nx == lastx && ny == lasty)
+			continue;
+		if (--count < maxsteps) {
+			path[count].w = nw;
+			path[count].x = nx;
+			path[count].y = ny;
+		}
+		lastw = nw;
+		lastx = nx;
+		lasty = ny;
+	}
+	
+	return length;
+}
@@ -0,0 +1,263 @@
+//
+//  profile.c
+//  Labyrinth
+//
+//  Frame-stage profiler: times each stage of a frame, per thread, and keeps
+//  the last PROFILE_FRAMES frames for the overlay (F3 in play mode). With
+//  -trace <file>, every stage of the session is also written out at exit as
+//  a Chrome trace (chrome://tracing or ui.perfetto.dev). Setting PROFILE to
+//  0 in labyrinth.h compiles the timers out.
+//
+
+#include "labyrinth.h"
+
+#define PROFILE_FRAMES		128		// rolling window for the overlay
+#define PROFILE_THREADS		64		// threads past this aren't timed
+#define TRACE_MAX			(1 << 20)	// events recorded per thread
+
+typedef struct
+{
+	uint64_t	start;
+	uint64_t	ticks;		// total this frame
+} stagetimer_t;
+
+typedef struct
+{
+	int			stage;
+	uint64_t	start, end;
+} traceevent_t;
+
+const char *stagenames[PS_COUNT + 1] =
+{
+	"input",
+	"movement",
+	"background",
+	"cast",
+	"walls",
+	"sprites",
+	"upload",
+	"present",
+	"frame"
+};
+
+bool			showprofile;
+stagetimer_t	timers[PROFILE_THREADS][PS_COUNT];
+
+// stage times in ms over the last PROFILE_FRAMES frames, the whole frame last
+float			history[PS_COUNT + 1][PROFILE_FRAMES];
+int				historyframes;
+int				historypos;
+uint64_t		framestart;
+
+char			*tracefile;
+uint64_t		tracestart;
+traceevent_t	*trace[PROFILE_THREADS];
+int				tracecount[PROFILE_THREADS];
+int				tracesize[PROFILE_THREADS];
+
+
+
+
+//
+// TraceEvent
+// Record a stage for the trace file. Each thread has its own buffer.
+//
+void TraceEvent (int thread, int stage, uint64_t start, uint64_t end)
+{
+	traceevent_t *event;
+	
+	if (tracecount[thread] == tracesize[thread])
+	{
+		if (tracesize[thread] == TRACE_MAX)
+			return; // full, keep what we have
+		tracesize[thread] = tracesize[thread] ? tracesize[thread] * 2 : 1024;
+		event = realloc(trace[thread], tracesize[thread] * sizeof(traceevent_t));
+		if (!event) {
+			tracesize[thread] = tracecount[thread];
+			return;
+		}
+		trace[thread] = event;
+	}
+	
+	event = &trace[thread][tracecount[thread]++];
+	event->stage = stage;
+	event->start = start;
+	event->end = end;
+}
+
+
+
+
+void ProfileBegin (stage_t stage, int thread)
+{
+	if (thread < PROFILE_THREADS)
+		timers[thread][stage].start = SDL_GetPerformanceCounter();
+}
+
+
+
+
+void ProfileEnd (stage_t stage, int thread)
+{
+	uint64_t now;
+	
+	if (thread >= PROFILE_THREADS)
+		return;
+	
+	now = SDL_GetPerformanceCounter();
+	timers[thread][stage].ticks += now - timers[thread][stage].start;
+	if (tracefile)
+		TraceEvent(thread, stage, timers[thread][stage].start, now);
+}
+
+
+
+
+//
+// ProfileFrame
+// Close out a frame: call once per frame from the main thread, when all
+// render threads are done. A stage's time for the frame is its longest
+// time on any thread, as the frame waits for the slowest strip.
+//
+void ProfileFrame (void)
+{
+	int			stage, thread;
+	uint64_t	now, ticks;
+	double		tickms;
+	
+	now = SDL_GetPerformanceCounter();
+	tickms = 1000.0 / SDL_GetPerformanceFrequency();
+	if (!framestart)
+		framestart = now;
+	
+	for (stage=0 ; stage<PS_COUNT ; stage++)
+	{
+		ticks = 0;
+		for (thread=0 ; thread<PROFILE_THREADS ; thread++) {
+			if (timers[thread][stage].ticks > ticks)
+				ticks = timers[thread][stage].ticks;
+			timers[thread][stage].ticks = 0;
+		}
+		history[stage][historypos] = ticks * tickms;
+	}
+	history[PS_COUNT][historypos] = (now - framestart) * tickms;
+	if (tracefile)
+		TraceEvent(0, PS_COUNT, framestart, now);
+	framestart = now;
+	
+	historypos = (historypos + 1) % PROFILE_FRAMES;
+	if (historyframes < PROFILE_FRAMES)
+		historyframes++;
+}
+
+
+
+
+//
+// DrawProfile
+// Overlay the average, median and 99th percentile time of each stage over
+// the last PROFILE_FRAMES frames, in ms
+//
+void DrawProfile (void)
+{
+	int			stage, i;
+	float		sorted[PROFILE_FRAMES];
+	float		total;
+	char		line[80];
+	SDL_Rect	backdrop = { 0, 0, 38 * 8, (PS_COUNT + 3) * 8 };
+	SDL_BlendMode	blend;
+	
+	if (!historyframes)
+		return;
+	
+	SDL_GetRenderDrawBlendMode(renderer, &blend);
+	SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 192);
+	SDL_RenderFillRect(renderer, &backdrop);
+	SDL_SetRenderDrawBlendMode(renderer, blend);
+	
+	sprintf(line, "stage (ms)    avg    p50    p99  %3d", historyframes);
+	print(1, 1, line);
+	for (stage=0 ; stage<=PS_COUNT ; stage++)
+	{
+		total = 0;
+		for (i=0 ; i<historyframes ; i++) {
+			sorted[i] = history[stage][i];
+			total += sorted[i];
+		}
+		qsort(sorted, historyframes, sizeof(float), CompareFloats);
+		
+		sprintf(line, "%-11s %6.2f %6.2f %6.2f", stagenames[stage],
+				total / historyframes, sorted[historyframes / 2],
+				sorted[(int)(0.99f * (historyframes - 1))]);
+		print(1, stage + 2, line);
+	}
+}
+
+
+
+
+//
+// StartTrace
+// Record every stage from now on, to be written to 'filename' at exit
+//
+void StartTrace (const char *filename)
+{
+	tracefile = strdup(filename);
+	tracestart = SDL_GetPerformanceCounter();
+	if (!PROFILE)
+		printf("StartTrace: Profiling is compiled out, %s will be empty\n", filename);
+}
+
+
+
+
+//
+// WriteTrace
+// Write the recorded stages as a Chrome trace, if -trace was given
+//
+void WriteTrace (void)
+{
+	FILE			*file;
+	int				thread, i;
+	double			tickus;
+	traceevent_t	*event;
+	const char		*separator = "";
+	
+	if (!tracefile)
+		return;
+	
+	file = fopen(tracefile, "w");
+	if (!file) {
+		printf("WriteTrace: Could not open %s\n", tracefile);
+		return;
+	}
+	
+	tickus = 1000000.0 / SDL_GetPerformanceFrequency();
+	fprintf(file, "{\"traceEvents\":[\n");
+	for (thread=0 ; thread<PROFILE_THREADS ; thread++)
+	{
+		if (!tracecount[thread])
+			continue;
+		
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+				"\"args\":{\"name\":\"%s %d\"}}", separator, thread,
+				thread ? "render" : "main", thread);
+		separator = ",\n";
+		
+		for (i=0 ; i<tracecount[thread] ; i++)
+		{
+			event = &trace[thread][i];
+			if (event->start < tracestart)
+				continue;
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+					"\"ts\":%.3f,\"dur\":%.3f}", stagenames[event->stage], thread,
+					(event->start - tracestart) * tickus,
+					(event->end - event->start) * tickus);
+		}
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	
+	printf("WriteTrace: Wrote %s\n", tracefile);
+}
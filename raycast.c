@@ -0,0 +1,263 @@
+//
+//  raycast.c
+//  Labyrinth
+//
+
+#include <math.h>
+
+#include "labyrinth.h"
+
+// skip field distances are capped, so an edit only affects tiles within
+// SKIP_MAX of it
+#define SKIP_MAX		32
+
+bool	emptyskip = true;	// use the skip field (-noskip to compare)
+
+
+
+
+//
+// OpenTile
+// Can a ray pass straight through tile x, y in dimension w?
+//
+bool OpenTile (int w, int x, int y)
+{
+	tiletype_t type = MapType(w, x, y);
+	return type == TT_EMPTY || type == TT_PLAYERSTART;
+}
+
+
+
+
+//
+// SkipDistance
+// Current skip field value at x, y, counting outside the map as solid
+//
+int SkipDistance (int w, int x, int y)
+{
+	if (!InMap(x, y))
+		return 0;
+	return map.skip[((size_t)w * map.height + y) * map.width + x];
+}
+
+
+
+
+//
+// Closer
+// Skip distance d, or one more than the distance at neighbor x, y if that
+// is smaller
+//
+int Closer (int d, int w, int x, int y)
+{
+	int neighbor = SkipDistance(w, x, y) + 1;
+	return neighbor < d ? neighbor : d;
+}
+
+
+
+
+//
+// UpdateSkipField
+// Recalculate the skip field of dimension w for tiles affected by a change
+// to the tiles in x1, y1 - x2, y2. A tile's skip distance is the
+// chessboard distance to the nearest tile a ray can't pass straight
+// through (wall, gate or the map edge), capped at SKIP_MAX: every tile
+// closer than that is open, so a ray can jump across them in one step.
+//
+// Two-pass chamfer transform over the affected area; tiles just outside
+// it keep their (unchanged) distances and seed the passes.
+//
+void UpdateSkipField (int w, int x1, int y1, int x2, int y2)
+{
+	int		x, y, d;
+	uint8_t	*skip;
+	
+	x1 = x1 - SKIP_MAX < 0 ? 0 : x1 - SKIP_MAX;
+	y1 = y1 - SKIP_MAX < 0 ? 0 : y1 - SKIP_MAX;
+	x2 = x2 + SKIP_MAX >= map.width ? map.width - 1 : x2 + SKIP_MAX;
+	y2 = y2 + SKIP_MAX >= map.height ? map.height - 1 : y2 + SKIP_MAX;
+	skip = map.skip + (size_t)w * map.width * map.height;
+	
+	for (y=y1 ; y<=y2 ; y++)
+		for (x=x1 ; x<=x2 ; x++)
+			skip[y * map.width + x] = OpenTile(w, x, y) ? SKIP_MAX : 0;
+	
+	// forward: from above and to the left
+	for (y=y1 ; y<=y2 ; y++)
+		for (x=x1 ; x<=x2 ; x++)
+		{
+			d = skip[y * map.width + x];
+			if (!d)
+				continue;
+			d = Closer(d, w, x-1, y);
+			d = Closer(d, w, x-1, y-1);
+			d = Closer(d, w, x, y-1);
+			d = Closer(d, w, x+1, y-1);
+			skip[y * map.width + x] = d;
+		}
+	
+	// backward: from below and to the right
+	for (y=y2 ; y>=y1 ; y--)
+		for (x=x2 ; x>=x1 ; x--)
+		{
+			d = skip[y * map.width + x];
+			if (!d)
+				continue;
+			d = Closer(d, w, x+1, y);
+			d = Closer(d, w, x+1, y+1);
+			d = Closer(d, w, x, y+1);
+			d = Closer(d, w, x-1, y+1);
+			skip[y * map.width + x] = d;
+		}
+}
+
+
+
+
+void BuildSkipField (void)
+{
+	int w;
+	
+	for (w=0 ; w<map.numdims ; w++)
+		UpdateSkipField(w, 0, 0, map.width-1, map.height-1);
+}
+
+
+
+
+//
+// CastRay
+// Step a ray from x, y in dimension w through the map grid one tile at a
+// time until it hits a wall. Gates switch the ray's dimension where it
+// crosses the gate's center line, the same place SlideMove would switch an
+// object. With emptyskip, open areas are crossed in one step using the
+// skip field. Returns false if the ray leaves the map or goes 'maxdist'
+// without hitting anything.
+//
+bool CastRay (float x, float y, int w, float dirx, float diry, float maxdist,
+			  drawinfo_t *info)
+{
+	int			mapx, mapy;		// tile the ray is in
+	int			stepx, stepy;
+	float		deltax, deltay;	// ray length to cross one tile
+	float		sidex, sidey;	// ray length to next x, y grid line
+	float		enter, leave;	// ray length at which current tile is entered, left
+	float		center;
+	float		jumpx, jumpy;	// ray length to leave an open area
+	int			open;			// size of open area around tile
+	side_t		face;			// face through which current tile was entered
+	tiletype_t	type;
+	bool		wasgate;
+	
+	mapx = (int)x;
+	mapy = (int)y;
+	deltax = dirx == 0.0f ? INFINITY : fabsf(1.0f / dirx);
+	deltay = diry == 0.0f ? INFINITY : fabsf(1.0f / diry);
+	
+	if (dirx < 0) {
+		stepx = -1;
+		sidex = (x - mapx) * deltax;
+	} else {
+		stepx = 1;
+		sidex = (mapx + 1.0f - x) * deltax;
+	}
+	if (diry < 0) {
+		stepy = -1;
+		sidey = (y - mapy) * deltay;
+	} else {
+		stepy = 1;
+		sidey = (mapy + 1.0f - y) * deltay;
+	}
+	
+	enter = 0.0f;
+	face = SIDE_UNDEFINED;
+	wasgate = false;
+	info->tiles = 0;
+	info->depth = INFINITY;
+	
+	while (InMap(mapx, mapy) && enter < maxdist)
+	{
+		info->tiles++;
+		
+		// only the skip field is read for open tiles
+		open = emptyskip ? SkipDistance(w, mapx, mapy) - 1 : -1;
+		if (open > 0)
+		{
+			// every tile within 'open' of this one is empty: jump straight
+			// to the tile where the ray leaves that square
+			jumpx = (stepx > 0 ? mapx + open + 1.0f - x : x - mapx + open) * deltax;
+			jumpy = (stepy > 0 ? mapy + open + 1.0f - y : y - mapy + open) * deltay;
+			
+			if (jumpx < jumpy) {
+				enter = jumpx;
+				mapx += stepx * (open + 1);
+				mapy = clamp((int)(y + diry * enter), mapy - open, mapy + open);
+				face = stepx > 0 ? SIDE_LEFT : SIDE_RIGHT;
+			} else {
+				enter = jumpy;
+				mapx = clamp((int)(x + dirx * enter), mapx - open, mapx + open);
+				mapy += stepy * (open + 1);
+				face = stepy > 0 ? SIDE_TOP : SIDE_BOTTOM;
+			}
+			sidex = (stepx > 0 ? mapx + 1.0f - x : x - mapx) * deltax;
+			sidey = (stepy > 0 ? mapy + 1.0f - y : y - mapy) * deltay;
+			wasgate = false;
+			continue;
+		}
+		type = open == 0 ? TT_EMPTY : MapType(w, mapx, mapy);
+		
+		if (type == TT_WALL)
+		{
+			info->dist = enter;
+			if (info->depth > enter)
+				info->depth = enter;
+			info->x = x + dirx * enter;
+			info->y = y + diry * enter;
+			info->tilex = mapx;
+			info->tiley = mapy;
+			info->w = w;
+			info->side = face;
+			// walls seen through a gate are drawn with the gate texture,
+			// dimension textures repeat past WT_STONE
+			info->texture = wasgate ? WT_FIRE : w % WT_FIRE;
+			if (face == SIDE_LEFT || face == SIDE_RIGHT)
+				info->samplex = info->y - mapy;
+			else
+				info->samplex = info->x - mapx;
+			return true;
+		}
+		
+		leave = sidex < sidey ? sidex : sidey;
+		
+		wasgate = type == TT_GATE_H || type == TT_GATE_V;
+		if (wasgate)
+		{
+			// find where the ray crosses the gate's center line (if at all)
+			if (type == TT_GATE_H)
+				center = dirx == 0.0f ? -1.0f : (mapx + 0.5f - x) / dirx;
+			else
+				center = diry == 0.0f ? -1.0f : (mapy + 0.5f - y) / diry;
+			
+			if (center >= enter && center < leave) {
+				if (GateDestination(w, mapx, mapy) != w && info->depth > center)
+					info->depth = center;
+				w = GateDestination(w, mapx, mapy);
+			}
+		}
+		
+		// move to the next tile
+		enter = leave;
+		if (sidex < sidey) {
+			sidex += deltax;
+			mapx += stepx;
+			face = stepx > 0 ? SIDE_LEFT : SIDE_RIGHT;
+		} else {
+			sidey += deltay;
+			mapy += stepy;
+			face = stepy > 0 ? SIDE_TOP : SIDE_BOTTOM;
+		}
+	}
+	
+	return false;
+}
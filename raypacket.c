@@ -0,0 +1,451 @@
+//
+//  raypacket.c
+//  Labyrinth
+//
+//  Packet ray caster: traces 4 (SSE2) or 8 (AVX2) adjacent screen columns
+//  together, one vector lane per column. Each lane takes the same steps as
+//  CastRay and ends on the same wall. A lane that reaches a gate drops out
+//  of the packet and is recast from the start with CastRay.
+//
+
+#include <math.h>
+
+#include "labyrinth.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PACKETS		1
+#else
+#define PACKETS		0	// no vector caster for this CPU, CastRay only
+#endif
+
+int			packetlanes;	// columns per packet, 0 to use CastRay only
+const char	*packetname = "scalar";
+
+
+
+
+//
+// LookupLanes
+// The scalar part of a packet step: read the map under each active lane.
+// Sets jump[i] to the size of the open area lane i can jump across (0 to
+// step one tile), and wall[i] or gate[i] to -1 if it entered a wall or gate.
+// Packets never leave dimension w, as gate lanes drop out.
+//
+void LookupLanes (int lanes, int w, const int *active, const int *mapx,
+				  const int *mapy, int *jump, int *wall, int *gate)
+{
+	int			i, open;
+	size_t		index;
+	tiletype_t	type;
+	
+	for (i=0 ; i<lanes ; i++)
+	{
+		jump[i] = wall[i] = gate[i] = 0;
+		if (!active[i])
+			continue;
+		
+		index = ((size_t)w * map.height + mapy[i]) * map.width + mapx[i];
+		open = emptyskip ? map.skip[index] - 1 : -1;
+		if (open > 0) {
+			jump[i] = open;
+			continue;
+		}
+		if (open == 0)
+			continue; // empty, next to something solid
+		
+		type = TileType(map.tiles[index]);
+		wall[i] = -(type == TT_WALL);
+		gate[i] = -(type == TT_GATE_H || type == TT_GATE_V);
+	}
+}
+
+
+
+
+//
+// FinishLanes
+// Fill in the drawinfo for each lane of a packet from its final state
+//
+void FinishLanes (int lanes, int hits, int w, const float *enter,
+				  const float *hitx, const float *hity, const int *mapx,
+				  const int *mapy, const int *face, const float *samplex,
+				  const int *height, const int *tiles, drawinfo_t *info)
+{
+	int i;
+	
+	for (i=0 ; i<lanes ; i++)
+	{
+		info[i].tiles = tiles[i];
+		info[i].depth = INFINITY;
+		if (!(hits & 1 << i))
+			continue;
+		
+		info[i].dist = enter[i];
+		info[i].depth = enter[i];
+		info[i].x = hitx[i];
+		info[i].y = hity[i];
+		info[i].tilex = mapx[i];
+		info[i].tiley = mapy[i];
+		info[i].w = w;
+		info[i].side = face[i];
+		info[i].texture = w % WT_FIRE;
+		info[i].samplex = samplex[i];
+		info[i].height = height[i];
+	}
+}
+
+
+
+
+#if PACKETS
+
+#define SELECT4(m, a, b)	_mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b))
+#define SELECT4F(m, a, b)	_mm_castsi128_ps(SELECT4(m, _mm_castps_si128(a), _mm_castps_si128(b)))
+#define CLAMP4(v, lo, hi)	SELECT4(_mm_cmplt_epi32(v, lo), lo, SELECT4(_mm_cmpgt_epi32(v, hi), hi, v))
+
+//
+// CastPacket4
+// SSE2 packet of four columns starting at 'column'
+//
+__attribute__((target("sse2")))
+int CastPacket4 (int column, drawinfo_t *info, int *scalar)
+{
+	__m128	x, y, dirx, diry, deltax, deltay, sidex, sidey, enter, maxdist;
+	__m128	leave, jumpx, jumpy, jenter, jsidex, jsidey, fmapx, fmapy, one;
+	__m128i	mapx, mapy, stepx, stepy, face, facex, facey, tiles;
+	__m128i	active, hit, gates, wall, gate, jump, jstep, xless, jx, usejump;
+	__m128i	smapx, smapy, jmapx, jmapy, negx, negy, width, height, none;
+	__m128	c, s, hitx, hity, samplex;
+	__m128i	ceiling, wallheight, vertical;
+	int		a[4], mx[4], my[4], jmp[4], wl[4], gt[4];
+	float	en[4], hx[4], hy[4], sx[4];
+	int		fc[4], ht[4], tl[4];
+	int		hits;
+	
+	one = _mm_set1_ps(1.0f);
+	none = _mm_set1_epi32(-1);
+	width = _mm_set1_epi32(map.width);
+	height = _mm_set1_epi32(map.height);
+	x = _mm_set1_ps(view.x);
+	y = _mm_set1_ps(view.y);
+	
+	// rotate view direction by each column's angle
+	c = _mm_loadu_ps(colcos + column);
+	s = _mm_loadu_ps(colsin + column);
+	maxdist = _mm_div_ps(_mm_set1_ps(viewdepth), c); // as CastColumn
+	dirx = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(view.sin), c), _mm_mul_ps(_mm_set1_ps(view.cos), s));
+	diry = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(view.cos), c), _mm_mul_ps(_mm_set1_ps(view.sin), s));
+	
+	mapx = _mm_set1_epi32((int)view.x);
+	mapy = _mm_set1_epi32((int)view.y);
+	fmapx = _mm_cvtepi32_ps(mapx);
+	fmapy = _mm_cvtepi32_ps(mapy);
+	deltax = _mm_andnot_ps(_mm_set1_ps(-0.0f), _mm_div_ps(one, dirx));
+	deltay = _mm_andnot_ps(_mm_set1_ps(-0.0f), _mm_div_ps(one, diry));
+	
+	negx = _mm_castps_si128(_mm_cmplt_ps(dirx, _mm_setzero_ps()));
+	negy = _mm_castps_si128(_mm_cmplt_ps(diry, _mm_setzero_ps()));
+	stepx = _mm_or_si128(negx, _mm_set1_epi32(1));
+	stepy = _mm_or_si128(negy, _mm_set1_epi32(1));
+	facex = SELECT4(negx, _mm_set1_epi32(SIDE_RIGHT), _mm_set1_epi32(SIDE_LEFT));
+	facey = SELECT4(negy, _mm_set1_epi32(SIDE_BOTTOM), _mm_set1_epi32(SIDE_TOP));
+	sidex = _mm_mul_ps(SELECT4F(negx, _mm_sub_ps(x, fmapx), _mm_sub_ps(_mm_add_ps(fmapx, one), x)), deltax);
+	sidey = _mm_mul_ps(SELECT4F(negy, _mm_sub_ps(y, fmapy), _mm_sub_ps(_mm_add_ps(fmapy, one), y)), deltay);
+	
+	enter = _mm_setzero_ps();
+	face = _mm_set1_epi32(SIDE_UNDEFINED);
+	tiles = hit = gates = _mm_setzero_si128();
+	active = none;
+	
+	while (1)
+	{
+		// lanes that left the map or the view are done
+		active = _mm_and_si128(active, _mm_cmpgt_epi32(mapx, none));
+		active = _mm_and_si128(active, _mm_cmplt_epi32(mapx, width));
+		active = _mm_and_si128(active, _mm_cmpgt_epi32(mapy, none));
+		active = _mm_and_si128(active, _mm_cmplt_epi32(mapy, height));
+		active = _mm_and_si128(active, _mm_castps_si128(_mm_cmplt_ps(enter, maxdist)));
+		if (!_mm_movemask_epi8(active))
+			break;
+		tiles = _mm_sub_epi32(tiles, active);
+		
+		_mm_storeu_si128((__m128i *)a, active);
+		_mm_storeu_si128((__m128i *)mx, mapx);
+		_mm_storeu_si128((__m128i *)my, mapy);
+		LookupLanes(4, view.w, a, mx, my, jmp, wl, gt);
+		jump = _mm_loadu_si128((__m128i *)jmp);
+		wall = _mm_loadu_si128((__m128i *)wl);
+		gate = _mm_loadu_si128((__m128i *)gt);
+		
+		hit = _mm_or_si128(hit, wall);
+		gates = _mm_or_si128(gates, gate);
+		active = _mm_andnot_si128(_mm_or_si128(wall, gate), active);
+		
+		// step to the next tile
+		xless = _mm_castps_si128(_mm_cmplt_ps(sidex, sidey));
+		leave = _mm_min_ps(sidex, sidey);
+		smapx = _mm_add_epi32(mapx, _mm_and_si128(xless, stepx));
+		smapy = _mm_add_epi32(mapy, _mm_andnot_si128(xless, stepy));
+		
+		// or jump across an open area
+		usejump = _mm_cmpgt_epi32(jump, _mm_setzero_si128());
+		jumpx = SELECT4F(negx, _mm_add_ps(_mm_sub_ps(x, fmapx), _mm_cvtepi32_ps(jump)),
+						 _mm_sub_ps(_mm_add_ps(_mm_cvtepi32_ps(_mm_add_epi32(mapx, jump)), one), x));
+		jumpy = SELECT4F(negy, _mm_add_ps(_mm_sub_ps(y, fmapy), _mm_cvtepi32_ps(jump)),
+						 _mm_sub_ps(_mm_add_ps(_mm_cvtepi32_ps(_mm_add_epi32(mapy, jump)), one), y));
+		jumpx = _mm_mul_ps(jumpx, deltax);
+		jumpy = _mm_mul_ps(jumpy, deltay);
+		jx = _mm_castps_si128(_mm_cmplt_ps(jumpx, jumpy));
+		jenter = SELECT4F(jx, jumpx, jumpy);
+		jstep = _mm_add_epi32(jump, _mm_set1_epi32(1));
+		jmapx = SELECT4(jx,
+						_mm_add_epi32(mapx, SELECT4(negx, _mm_sub_epi32(_mm_setzero_si128(), jstep), jstep)),
+						CLAMP4(_mm_cvttps_epi32(_mm_add_ps(x, _mm_mul_ps(dirx, jenter))),
+							   _mm_sub_epi32(mapx, jump), _mm_add_epi32(mapx, jump)));
+		jmapy = SELECT4(jx,
+						CLAMP4(_mm_cvttps_epi32(_mm_add_ps(y, _mm_mul_ps(diry, jenter))),
+							   _mm_sub_epi32(mapy, jump), _mm_add_epi32(mapy, jump)),
+						_mm_add_epi32(mapy, SELECT4(negy, _mm_sub_epi32(_mm_setzero_si128(), jstep), jstep)));
+		fmapx = _mm_cvtepi32_ps(jmapx);
+		fmapy = _mm_cvtepi32_ps(jmapy);
+		jsidex = _mm_mul_ps(SELECT4F(negx, _mm_sub_ps(x, fmapx), _mm_sub_ps(_mm_add_ps(fmapx, one), x)), deltax);
+		jsidey = _mm_mul_ps(SELECT4F(negy, _mm_sub_ps(y, fmapy), _mm_sub_ps(_mm_add_ps(fmapy, one), y)), deltay);
+		
+		// active lanes take whichever applies, the rest keep their state
+		xless = SELECT4(usejump, jx, xless);
+		enter = SELECT4F(active, SELECT4F(usejump, jenter, leave), enter);
+		face = SELECT4(active, SELECT4(xless, facex, facey), face);
+		sidex = SELECT4F(active, SELECT4F(usejump, jsidex,
+						 SELECT4F(xless, _mm_add_ps(sidex, deltax), sidex)), sidex);
+		sidey = SELECT4F(active, SELECT4F(usejump, jsidey,
+						 SELECT4F(xless, sidey, _mm_add_ps(sidey, deltay))), sidey);
+		mapx = SELECT4(active, SELECT4(usejump, jmapx, smapx), mapx);
+		mapy = SELECT4(active, SELECT4(usejump, jmapy, smapy), mapy);
+		fmapx = _mm_cvtepi32_ps(mapx);
+		fmapy = _mm_cvtepi32_ps(mapy);
+	}
+	
+	// hit point, texture column and projected height
+	hitx = _mm_add_ps(x, _mm_mul_ps(dirx, enter));
+	hity = _mm_add_ps(y, _mm_mul_ps(diry, enter));
+	vertical = _mm_or_si128(_mm_cmpeq_epi32(face, _mm_set1_epi32(SIDE_LEFT)),
+							_mm_cmpeq_epi32(face, _mm_set1_epi32(SIDE_RIGHT)));
+	samplex = SELECT4F(vertical, _mm_sub_ps(hity, fmapy), _mm_sub_ps(hitx, fmapx));
+	ceiling = _mm_cvttps_epi32(_mm_sub_ps(_mm_set1_ps(halfheight),
+										  _mm_div_ps(_mm_set1_ps(winh), _mm_mul_ps(enter, c))));
+	wallheight = _mm_sub_epi32(_mm_sub_epi32(_mm_set1_epi32(winh), ceiling), ceiling);
+	
+	hits = _mm_movemask_ps(_mm_castsi128_ps(hit));
+	*scalar = _mm_movemask_ps(_mm_castsi128_ps(gates));
+	_mm_storeu_ps(en, enter);
+	_mm_storeu_ps(hx, hitx);
+	_mm_storeu_ps(hy, hity);
+	_mm_storeu_ps(sx, samplex);
+	_mm_storeu_si128((__m128i *)mx, mapx);
+	_mm_storeu_si128((__m128i *)my, mapy);
+	_mm_storeu_si128((__m128i *)fc, face);
+	_mm_storeu_si128((__m128i *)ht, wallheight);
+	_mm_storeu_si128((__m128i *)tl, tiles);
+	FinishLanes(4, hits, view.w, en, hx, hy, mx, my, fc, sx, ht, tl, info);
+	
+	return hits;
+}
+
+
+
+
+#define SELECT8(m, a, b)	_mm256_blendv_epi8(b, a, m)
+#define SELECT8F(m, a, b)	_mm256_blendv_ps(b, a, _mm256_castsi256_ps(m))
+#define CLAMP8(v, lo, hi)	_mm256_max_epi32(lo, _mm256_min_epi32(v, hi))
+
+//
+// CastPacket8
+// AVX2 packet of eight columns starting at 'column', same steps as
+// CastPacket4
+//
+__attribute__((target("avx2")))
+int CastPacket8 (int column, drawinfo_t *info, int *scalar)
+{
+	__m256	x, y, dirx, diry, deltax, deltay, sidex, sidey, enter, maxdist;
+	__m256	leave, jumpx, jumpy, jenter, jsidex, jsidey, fmapx, fmapy, one;
+	__m256i	mapx, mapy, stepx, stepy, face, facex, facey, tiles;
+	__m256i	active, hit, gates, wall, gate, jump, xless, jx, usejump;
+	__m256i	smapx, smapy, jmapx, jmapy, negx, negy, width, height, none;
+	__m256	c, s, hitx, hity, samplex;
+	__m256i	ceiling, wallheight, vertical;
+	int		a[8], mx[8], my[8], jmp[8], wl[8], gt[8];
+	float	en[8], hx[8], hy[8], sx[8];
+	int		fc[8], ht[8], tl[8];
+	int		hits;
+	
+	one = _mm256_set1_ps(1.0f);
+	none = _mm256_set1_epi32(-1);
+	width = _mm256_set1_epi32(map.width);
+	height = _mm256_set1_epi32(map.height);
+	x = _mm256_set1_ps(view.x);
+	y = _mm256_set1_ps(view.y);
+	
+	c = _mm256_loadu_ps(colcos + column);
+	s = _mm256_loadu_ps(colsin + column);
+	maxdist = _mm256_div_ps(_mm256_set1_ps(viewdepth), c);
+	dirx = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(view.sin), c), _mm256_mul_ps(_mm256_set1_ps(view.cos), s));
+	diry = _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(view.cos), c), _mm256_mul_ps(_mm256_set1_ps(view.sin), s));
+	
+	mapx = _mm256_set1_epi32((int)view.x);
+	mapy = _mm256_set1_epi32((int)view.y);
+	fmapx = _mm256_cvtepi32_ps(mapx);
+	fmapy = _mm256_cvtepi32_ps(mapy);
+	deltax = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), _mm256_div_ps(one, dirx));
+	deltay = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), _mm256_div_ps(one, diry));
+	
+	negx = _mm256_castps_si256(_mm256_cmp_ps(dirx, _mm256_setzero_ps(), _CMP_LT_OQ));
+	negy = _mm256_castps_si256(_mm256_cmp_ps(diry, _mm256_setzero_ps(), _CMP_LT_OQ));
+	stepx = _mm256_or_si256(negx, _mm256_set1_epi32(1));
+	stepy = _mm256_or_si256(negy, _mm256_set1_epi32(1));
+	facex = SELECT8(negx, _mm256_set1_epi32(SIDE_RIGHT), _mm256_set1_epi32(SIDE_LEFT));
+	facey = SELECT8(negy, _mm256_set1_epi32(SIDE_BOTTOM), _mm256_set1_epi32(SIDE_TOP));
+	sidex = _mm256_mul_ps(SELECT8F(negx, _mm256_sub_ps(x, fmapx), _mm256_sub_ps(_mm256_add_ps(fmapx, one), x)), deltax);
+	sidey = _mm256_mul_ps(SELECT8F(negy, _mm256_sub_ps(y, fmapy), _mm256_sub_ps(_mm256_add_ps(fmapy, one), y)), deltay);
+	
+	enter = _mm256_setzero_ps();
+	face = _mm256_set1_epi32(SIDE_UNDEFINED);
+	tiles = hit = gates = _mm256_setzero_si256();
+	active = none;
+	
+	while (1)
+	{
+		active = _mm256_and_si256(active, _mm256_cmpgt_epi32(mapx, none));
+		active = _mm256_and_si256(active, _mm256_cmpgt_epi32(width, mapx));
+		active = _mm256_and_si256(active, _mm256_cmpgt_epi32(mapy, none));
+		active = _mm256_and_si256(active, _mm256_cmpgt_epi32(height, mapy));
+		active = _mm256_and_si256(active, _mm256_castps_si256(_mm256_cmp_ps(enter, maxdist, _CMP_LT_OQ)));
+		if (!_mm256_movemask_epi8(active))
+			break;
+		tiles = _mm256_sub_epi32(tiles, active);
+		
+		_mm256_storeu_si256((__m256i *)a, active);
+		_mm256_storeu_si256((__m256i *)mx, mapx);
+		_mm256_storeu_si256((__m256i *)my, mapy);
+		LookupLanes(8, view.w, a, mx, my, jmp, wl, gt);
+		jump = _mm256_loadu_si256((__m256i *)jmp);
+		wall = _mm256_loadu_si256((__m256i *)wl);
+		gate = _mm256_loadu_si256((__m256i *)gt);
+		
+		hit = _mm256_or_si256(hit, wall);
+		gates = _mm256_or_si256(gates, gate);
+		active = _mm256_andnot_si256(_mm256_or_si256(wall, gate), active);
+		
+		xless = _mm256_castps_si256(_mm256_cmp_ps(sidex, sidey, _CMP_LT_OQ));
+		leave = _mm256_min_ps(sidex, sidey);
+		smapx = _mm256_add_epi32(mapx, _mm256_and_si256(xless, stepx));
+		smapy = _mm256_add_epi32(mapy, _mm256_andnot_si256(xless, stepy));
+		
+		usejump = _mm256_cmpgt_epi32(jump, _mm256_setzero_si256());
+		jumpx = SELECT8F(negx, _mm256_add_ps(_mm256_sub_ps(x, fmapx), _mm256_cvtepi32_ps(jump)),
+						 _mm256_sub_ps(_mm256_add_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(mapx, jump)), one), x));
+		jumpy = SELECT8F(negy, _mm256_add_ps(_mm256_sub_ps(y, fmapy), _mm256_cvtepi32_ps(jump)),
+						 _mm256_sub_ps(_mm256_add_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(mapy, jump)), one), y));
+		jumpx = _mm256_mul_ps(jumpx, deltax);
+		jumpy = _mm256_mul_ps(jumpy, deltay);
+		jx = _mm256_castps_si256(_mm256_cmp_ps(jumpx, jumpy, _CMP_LT_OQ));
+		jenter = SELECT8F(jx, jumpx, jumpy);
+		jmapx = SELECT8(jx,
+						_mm256_add_epi32(mapx, _mm256_sign_epi32(_mm256_add_epi32(jump, _mm256_set1_epi32(1)), stepx)),
+						CLAMP8(_mm256_cvttps_epi32(_mm256_add_ps(x, _mm256_mul_ps(dirx, jenter))),
+							   _mm256_sub_epi32(mapx, jump), _mm256_add_epi32(mapx, jump)));
+		jmapy = SELECT8(jx,
+						CLAMP8(_mm256_cvttps_epi32(_mm256_add_ps(y, _mm256_mul_ps(diry, jenter))),
+							   _mm256_sub_epi32(mapy, jump), _mm256_add_epi32(mapy, jump)),
+						_mm256_add_epi32(mapy, _mm256_sign_epi32(_mm256_add_epi32(jump, _mm256_set1_epi32(1)), stepy)));
+		fmapx = _mm256_cvtepi32_ps(jmapx);
+		fmapy = _mm256_cvtepi32_ps(jmapy);
+		jsidex = _mm256_mul_ps(SELECT8F(negx, _mm256_sub_ps(x, fmapx), _mm256_sub_ps(_mm256_add_ps(fmapx, one), x)), deltax);
+		jsidey = _mm256_mul_ps(SELECT8F(negy, _mm256_sub_ps(y, fmapy), _mm256_sub_ps(_mm256_add_ps(fmapy, one), y)), deltay);
+		
+		xless = SELECT8(usejump, jx, xless);
+		enter = SELECT8F(active, SELECT8F(usejump, jenter, leave), enter);
+		face = SELECT8(active, SELECT8(xless, facex, facey), face);
+		sidex = SELECT8F(active, SELECT8F(usejump, jsidex,
+						 SELECT8F(xless, _mm256_add_ps(sidex, deltax), sidex)), sidex);
+		sidey = SELECT8F(active, SELECT8F(usejump, jsidey,
+						 SELECT8F(xless, sidey, _mm256_add_ps(sidey, deltay))), sidey);
+		mapx = SELECT8(active, SELECT8(usejump, jmapx, smapx), mapx);
+		mapy = SELECT8(active, SELECT8(usejump, jmapy, smapy), mapy);
+		fmapx = _mm256_cvtepi32_ps(mapx);
+		fmapy = _mm256_cvtepi32_ps(mapy);
+	}
+	
+	hitx = _mm256_add_ps(x, _mm256_mul_ps(dirx, enter));
+	hity = _mm256_add_ps(y, _mm256_mul_ps(diry, enter));
+	vertical = _mm256_or_si256(_mm256_cmpeq_epi32(face, _mm256_set1_epi32(SIDE_LEFT)),
+							   _mm256_cmpeq_epi32(face, _mm256_set1_epi32(SIDE_RIGHT)));
+	samplex = SELECT8F(vertical, _mm256_sub_ps(hity, fmapy), _mm256_sub_ps(hitx, fmapx));
+	ceiling = _mm256_cvttps_epi32(_mm256_sub_ps(_mm256_set1_ps(halfheight),
+												_mm256_div_ps(_mm256_set1_ps(winh), _mm256_mul_ps(enter, c))));
+	wallheight = _mm256_sub_epi32(_mm256_sub_epi32(_mm256_set1_epi32(winh), ceiling), ceiling);
+	
+	hits = _mm256_movemask_ps(_mm256_castsi256_ps(hit));
+	*scalar = _mm256_movemask_ps(_mm256_castsi256_ps(gates));
+	_mm256_storeu_ps(en, enter);
+	_mm256_storeu_ps(hx, hitx);
+	_mm256_storeu_ps(hy, hity);
+	_mm256_storeu_ps(sx, samplex);
+	_mm256_storeu_si256((__m256i *)mx, mapx);
+	_mm256_storeu_si256((__m256i *)my, mapy);
+	_mm256_storeu_si256((__m256i *)fc, face);
+	_mm256_storeu_si256((__m256i *)ht, wallheight);
+	_mm256_storeu_si256((__m256i *)tl, tiles);
+	FinishLanes(8, hits, view.w, en, hx, hy, mx, my, fc, sx, ht, tl, info);
+	
+	return hits;
+}
+
+#endif
+
+
+
+
+//
+// SelectPacketCaster
+// Use the widest packet caster this CPU supports, or none if not 'allowed'
+//
+void SelectPacketCaster (bool allowed)
+{
+	packetlanes = 0;
+	packetname = "scalar";
+
+#if PACKETS
+	if (!allowed)
+		return;
+	
+	if (SDL_HasAVX2()) {
+		packetlanes = 8;
+		packetname = "avx2";
+	} else if (SDL_HasSSE2()) {
+		packetlanes = 4;
+		packetname = "sse2";
+	}
+#endif
+}
+
+
+
+
+//
+// CastPacket
+// Cast rays for the packetlanes columns starting at 'column' from the
+// view. Returns a bit mask of the lanes that hit a wall, and sets *scalar
+// to the lanes that reached a gate and need CastRay instead.
+//
+int CastPacket (int column, drawinfo_t *info, int *scalar)
+{
+#if PACKETS
+	if (packetlanes == 8)
+		return CastPacket8(column, info, scalar);
+	if (packetlanes == 4)
+		return CastPacket4(column, info, scalar);
+#endif
+	*scalar = (1 << packetlanes) - 1;
+	return 0;
+}
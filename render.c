@@ -0,0 +1,1094 @@
+//
+//  render.c
+//  Labyrinth
+//
+//  3D view: rays are cast and walls drawn into a software framebuffer,
+//  which is uploaded to a single streaming texture once per frame.
+//
+
+#include <math.h>
+
+#include "labyrinth.h"
+
+#define SHADE 1
+
+#define ARGB(r,g,b)		(0xFF000000 | (r) << 16 | (g) << 8 | (b))
+
+#define SHADE_DIST		2.35f	// walls closer than this are fully lit
+#define FOG_START		0.5f	// fog begins at this fraction of viewdepth
+
+#define MAX_TEXHEIGHT	1024	// tallest wall texture DrawWallColumn takes
+
+#define FLOOR_TEXTURE	WT_STONE	// for -texfloor
+#define CEILING_TEXTURE	WT_CEMENT
+
+#define SHADEBITS		5
+#define NUMSHADES		(1 << SHADEBITS)
+
+#define SPRITE_SIZE		32		// actor sprite texels across
+#define SPRITE_NEAR		0.05f	// sprites closer than this aren't drawn
+#define CELL_REACH		1.0f	// grid cell center to the edge of an actor in it
+
+// wall surface pre-converted to 32-bit texels stored column by column,
+// so a wall slice is a linear walk through memory
+typedef struct
+{
+	int			width;
+	int			height;
+	uint32_t	*texels; // width * height, column-major
+} texcache_t;
+
+const float     fov = ANG90 / 2;
+float			viewdepth = 16.0f;	// how deep the view reaches, fogged out by then
+obj_t			view;				// camera for the frame being drawn
+
+int				winw = DEFAULT_W;	// view size in pixels
+int				winh = DEFAULT_H;
+int				halfheight = DEFAULT_H / 2;
+
+uint32_t		*framebuffer;		// winw * winh ARGB pixels
+SDL_Texture		*frametexture;
+
+// sin and cos of each column's ray angle relative to the view direction,
+// rebuilt by SetViewSize
+float			*colsin;
+float			*colcos;
+float			*coltan;
+
+drawinfo_t		*columns;	// this frame's ray hit in each column, height 0 if none
+
+// ray cache (-raycache): while the view only turns, rays are reused by
+// angle. The view angle is snapped to a multiple of the column spacing, so
+// turning shifts the columns a whole number of slots around a ring that
+// covers every angle; a column only needs casting if its slot is stale.
+typedef struct
+{
+	drawinfo_t	info;
+	bool		hit;
+	float		cos;		// colcos of the column it was cast for
+	unsigned	stamp;		// valid if equal to cachestamp
+} cachedray_t;
+
+bool			raycache;
+cachedray_t		*cachedrays;
+int				numslots;	// slots in a full turn
+int				viewslot;	// slot of column 0 this frame
+unsigned		cachestamp = 1;
+obj_t			cacheview;	// position the cached rays are from
+unsigned		cacheversion;
+float			cachedepth;
+
+// floor and ceiling: a gradient image rebuilt only when its colors, the
+// view size or the view depth change, or textures (-texfloor)
+bool			texturedfloor;
+uint32_t		*background;
+SDL_Color		backfloor, backceiling;
+float			backdepth;
+float			*rowdist;	// distance to the floor or ceiling seen in each row
+int				*rowlight;	// light level of the floor or ceiling in each row (0-256)
+
+texcache_t		texcache[WT_COUNT];
+
+// shadetable[light][c]: color component c scaled by light level
+uint8_t			shadetable[NUMSHADES][256];
+
+// actor sprites in view this frame, far to near, found with the actor grid
+typedef struct
+{
+	float	depth;		// distance in front of the view
+	float	left;		// left edge in columns, unclipped
+	float	width;		// in columns
+	int		x1, x2;		// columns covered, clipped to the view
+	int		top;		// rows, unclipped
+	int		height;
+	int		light;
+} sprite_t;
+
+uint32_t		spritetexels[SPRITE_SIZE * SPRITE_SIZE];	// column-major, 0 is clear
+sprite_t		*sprites;
+int				numsprites;
+int				maxsprites;
+float			*coldepth;	// per column: distance in front of the view to the
+							// first wall or gate, sprites past it are hidden
+
+// render thread pool: each thread draws its own strip of columns
+typedef struct
+{
+	SDL_Thread	*thread;
+	int			index;
+	int			rays;	// rays cast for the strip last frame
+	int			tiles;
+} worker_t;
+
+int				numthreads = 1;	// including the main thread
+worker_t		*workers;
+SDL_mutex		*poolmutex;
+SDL_cond		*startcond;		// signalled when a frame is ready to draw
+SDL_cond		*donecond;		// signalled when the last strip is done
+int				framenum;		// incremented to start workers on a frame
+int				pending;		// strips still being drawn
+
+int				raycount;
+int				tilecount;
+
+
+
+
+//
+// BuildColumnTables
+// Calculate each column's ray angle offset once, so a ray's direction is
+// the player's direction rotated by a table lookup (and the cos term
+// corrects distance to the view plane)
+//
+void BuildColumnTables (void)
+{
+	int		x;
+	float	angle;
+	
+	free(colsin);
+	free(colcos);
+	free(coltan);
+	colsin = malloc(winw * sizeof(float));
+	colcos = malloc(winw * sizeof(float));
+	coltan = malloc(winw * sizeof(float));
+	if (!colsin || !colcos || !coltan)
+		Quit("BuildColumnTables: Out of memory");
+	
+	for (x=0 ; x<winw ; x++)
+	{
+		angle = fov/2.0f - (float)x/winw*fov;
+		colsin[x] = sinf(angle);
+		colcos[x] = cosf(angle);
+		coltan[x] = colsin[x] / colcos[x];
+	}
+}
+
+
+
+
+//
+// SetViewSize
+// Set the size of the 3D view in pixels and (re)allocate the framebuffer
+//
+void SetViewSize (int width, int height)
+{
+	winw = width;
+	winh = height;
+	halfheight = winh / 2;
+	
+	free(framebuffer);
+	free(columns);
+	free(cachedrays);
+	free(coldepth);
+	free(background);
+	free(rowdist);
+	free(rowlight);
+	framebuffer = malloc(winw * winh * sizeof(uint32_t));
+	columns = malloc(winw * sizeof(drawinfo_t));
+	numslots = winw * 8; // fov is 1/8 turn
+	cachedrays = calloc(numslots, sizeof(cachedray_t));
+	coldepth = malloc(winw * sizeof(float));
+	background = NULL; // rebuilt by the next RenderView
+	rowdist = malloc(winh * sizeof(float));
+	rowlight = malloc(winh * sizeof(int));
+	if (!framebuffer || !columns || !cachedrays || !coldepth || !rowdist || !rowlight)
+		Quit("SetViewSize: Out of memory");
+	
+	BuildColumnTables();
+	
+	if (!renderer)
+		return; // headless (-bench)
+	
+	if (frametexture)
+		SDL_DestroyTexture(frametexture);
+	frametexture = SDL_CreateTexture(renderer,
+									 SDL_PIXELFORMAT_ARGB8888,
+									 SDL_TEXTUREACCESS_STREAMING,
+									 winw, winh);
+	if (!frametexture)
+		Quit("SetViewSize: Could not create frame texture");
+}
+
+
+
+
+//
+// BuildActorSprite
+// Draw the actor sprite: a ball lit from the upper left
+//
+void BuildActorSprite (void)
+{
+	int		x, y;
+	float	nx, ny, nz, light;
+	
+	for (x=0 ; x<SPRITE_SIZE ; x++)
+		for (y=0 ; y<SPRITE_SIZE ; y++)
+		{
+			nx = (x + 0.5f) / (SPRITE_SIZE / 2) - 1.0f;
+			ny = (y + 0.5f) / (SPRITE_SIZE / 2) - 1.0f;
+			nz = 1.0f - nx*nx - ny*ny;
+			if (nz <= 0.0f) {
+				spritetexels[x * SPRITE_SIZE + y] = 0;
+				continue;
+			}
+			
+			light = 0.35f + 0.65f * fmaxf(0.0f, (-nx - ny + sqrtf(nz)) / sqrtf(3.0f));
+			spritetexels[x * SPRITE_SIZE + y] =
+				ARGB((int)(220 * light), (int)(90 * light), (int)(40 * light));
+		}
+}
+
+
+
+
+//
+// InitTextureCache
+// Convert each wall surface to column-major ARGB texels and build the
+// shade table and actor sprite. Call once after the wall surfaces are
+// loaded.
+//
+void InitTextureCache (void)
+{
+	int			i, x, y;
+	int			light, c;
+	SDL_Surface	*s;
+	uint32_t	*row;
+	texcache_t	*tex;
+	
+	for (i=0 ; i<WT_COUNT ; i++)
+	{
+		s = SDL_ConvertSurfaceFormat(walls[i], SDL_PIXELFORMAT_ARGB8888, 0);
+		if (!s)
+			Quit("InitTextureCache: Could not convert wall surface");
+		
+		tex = &texcache[i];
+		tex->width = s->w;
+		tex->height = s->h;
+		if (tex->height > MAX_TEXHEIGHT)
+			Quit("InitTextureCache: Wall texture is too tall");
+		tex->texels = malloc(s->w * s->h * sizeof(uint32_t));
+		if (!tex->texels)
+			Quit("InitTextureCache: Out of memory");
+		
+		SDL_LockSurface(s);
+		for (y=0 ; y<s->h ; y++)
+		{
+			row = (uint32_t *)((uint8_t *)s->pixels + y * s->pitch);
+			for (x=0 ; x<s->w ; x++)
+				tex->texels[x * s->h + y] = row[x];
+		}
+		SDL_UnlockSurface(s);
+		SDL_FreeSurface(s);
+	}
+	
+	for (light=0 ; light<NUMSHADES ; light++)
+		for (c=0 ; c<256 ; c++)
+			shadetable[light][c] = c * light / (NUMSHADES - 1);
+	
+	BuildActorSprite();
+}
+
+
+
+
+//
+// Fog
+// Returns how much of something at dist shows through the fog: all of it
+// up to FOG_START of the view depth, falling to none at the view depth
+//
+float Fog (float dist)
+{
+	float start = viewdepth * FOG_START;
+	
+	if (dist <= start)
+		return 1.0f;
+	if (dist >= viewdepth)
+		return 0.0f;
+	return (viewdepth - dist) / (viewdepth - start);
+}
+
+
+
+
+//
+// BuildBackground
+// Build the floor and ceiling gradient image and row tables: both are
+// brightest at the top/bottom of the screen and fade out toward the horizon,
+// and rows showing floor or ceiling past the fog line are black
+//
+void BuildBackground (SDL_Color *floor, SDL_Color *ceiling)
+{
+	int			x, y;
+	int			a;
+	float		dist, brightness;
+	uint32_t	color;
+	uint32_t	*row;
+	
+	free(background);
+	background = malloc(winw * winh * sizeof(uint32_t));
+	if (!background)
+		Quit("BuildBackground: Out of memory");
+	backfloor = *floor;
+	backceiling = *ceiling;
+	backdepth = viewdepth;
+	
+	for (y=0 ; y<winh ; y++)
+	{
+		if (y < halfheight) {
+			dist = winh / (halfheight - y - 0.5f);
+			a = (255 - y * 200 / halfheight) * Fog(dist);
+			color = ARGB(ceiling->r*a/255, ceiling->g*a/255, ceiling->b*a/255);
+		} else {
+			dist = winh / (y - halfheight + 0.5f);
+			a = (255 - (winh - 1 - y) * 200 / halfheight) * Fog(dist);
+			color = ARGB(floor->r*a/255, floor->g*a/255, floor->b*a/255);
+		}
+		row = background + y * winw;
+		for (x=0 ; x<winw ; x++)
+			row[x] = color;
+		
+		// lit like a wall at that distance
+#if SHADE
+		brightness = dist < SHADE_DIST ? 1.0f : SHADE_DIST / dist;
+#else
+		brightness = 1.0f;
+#endif
+		rowdist[y] = dist;
+		rowlight[y] = 256 * brightness * Fog(dist);
+	}
+}
+
+
+
+
+//
+// SetTexturedFloor
+// Draw textured floor and ceiling instead of the gradients. The textures
+// must be a power of two in both directions.
+//
+void SetTexturedFloor (bool on)
+{
+	texcache_t *floor = &texcache[FLOOR_TEXTURE];
+	texcache_t *ceiling = &texcache[CEILING_TEXTURE];
+	
+	if (on && ((floor->width & (floor->width - 1)) || (floor->height & (floor->height - 1))
+			   || (ceiling->width & (ceiling->width - 1))
+			   || (ceiling->height & (ceiling->height - 1)))) {
+		printf("SetTexturedFloor: Floor and ceiling textures must be a power of two in size\n");
+		on = false;
+	}
+	texturedfloor = on;
+}
+
+
+
+
+//
+// DrawTexturedRow
+// Draw columns x1 - x2 (exclusive) of floor or ceiling row y: the
+// distance to the row comes from rowdist, so each pixel's spot on the
+// floor is one multiply-add along the row from the center column's
+//
+void DrawTexturedRow (int y, int x1, int x2)
+{
+	texcache_t	*tex;
+	float		dist;
+	float		basex, basey;	// floor under the center of the view
+	float		rightx, righty;	// floor offset per unit of coltan
+	int			x, u, v;
+	int			light;
+	int			umask, vmask, vbits;
+	float		width, height;
+	uint32_t	texel;
+	uint32_t	*row;
+	
+	tex = y < halfheight ? &texcache[CEILING_TEXTURE] : &texcache[FLOOR_TEXTURE];
+	dist = rowdist[y];
+	light = rowlight[y];
+	basex = view.x + view.sin * dist;
+	basey = view.y + view.cos * dist;
+	rightx = view.cos * dist;
+	righty = -view.sin * dist;
+	
+	width = tex->width;
+	height = tex->height;
+	umask = tex->width - 1;
+	vmask = tex->height - 1;
+	for (vbits=0 ; 1 << vbits < tex->height ; vbits++)
+		;
+	row = framebuffer + y * winw;
+	
+	for (x=x1 ; x<x2 ; x++)
+	{
+		u = (int)((basex + coltan[x] * rightx) * width) & umask;
+		v = (int)((basey + coltan[x] * righty) * height) & vmask;
+		texel = tex->texels[u << vbits | v];
+		row[x] = 0xFF000000
+			| ((texel & 0xFF00FF) * light >> 8 & 0xFF00FF)
+			| ((texel & 0x00FF00) * light >> 8 & 0x00FF00);
+	}
+}
+
+
+
+
+//
+// DrawBackground
+// Fill rows y1 - y2 (exclusive) of columns x1 - x2 with the floor and
+// ceiling. With one strip the rows are contiguous and go in one copy.
+//
+void DrawBackground (int x1, int x2, int y1, int y2)
+{
+	int y;
+	
+	if (y1 >= y2)
+		return;
+	
+	if (texturedfloor) {
+		for (y=y1 ; y<y2 ; y++)
+			DrawTexturedRow(y, x1, x2);
+	} else if (x1 == 0 && x2 == winw) {
+		memcpy(framebuffer + y1 * winw, background + y1 * winw,
+			   (y2 - y1) * winw * sizeof(uint32_t));
+	} else {
+		for (y=y1 ; y<y2 ; y++)
+			memcpy(framebuffer + y * winw + x1, background + y * winw + x1,
+				   (x2 - x1) * sizeof(uint32_t));
+	}
+}
+
+
+
+
+//
+// CalcHeight
+// Calulate wall height from its distance to the view plane
+//
+int CalcHeight (float distadj)
+{
+	int ceiling, floor;
+	
+	ceiling = (float)halfheight - (winh / distadj);
+	floor = winh - ceiling;
+	
+	return floor - ceiling;
+}
+
+
+
+
+//
+// DrawWallColumn
+// Draw the textured wall slice for one screen column. The slice is clipped
+// to the screen first, then stepped through the texture column in 16.16
+// fixed point, so the only divide is the one that sets up the step. When
+// the slice has more rows than texels (a close wall), the texels it covers
+// are shaded once up front instead of once per row.
+//
+void DrawWallColumn (int x, drawinfo_t *info)
+{
+	texcache_t	*tex;
+	uint32_t	*column;
+	uint32_t	*pixel;
+	uint32_t	texel;
+	uint8_t		*shade;
+	int			wallheight;
+	int			y, top, bottom;
+	int			texx;
+	uint32_t	texy, step;	// 16.16 texture row
+	uint32_t	shaded[MAX_TEXHEIGHT];
+	int			first, last;
+	int			pitch;		// a local, as stores to pixel could alias it
+	int			light;
+	float		dist;
+	float		brightness;
+	
+	tex = &texcache[info->texture];
+	dist = info->dist * colcos[x];
+	wallheight = info->height;
+	if (wallheight <= 0)
+		return;
+	
+	int ceiling = halfheight-wallheight/2;
+	int floor = halfheight+wallheight/2;
+	
+#if SHADE
+	// distant walls fade to black
+	brightness = dist < SHADE_DIST ? 1.0f : SHADE_DIST / dist;
+#else
+	brightness = 1.0f;
+#endif
+	light = 255 * brightness * Fog(dist);
+	shade = shadetable[light >> (8 - SHADEBITS)];
+	
+	top = ceiling < 0 ? 0 : ceiling;
+	bottom = floor > winh ? winh : floor;
+	texx = (int)(info->samplex * tex->width);
+	if (texx >= tex->width)
+		texx = tex->width - 1; // intercept exactly on the far edge
+	column = tex->texels + texx * tex->height;
+	
+	if (top >= bottom)
+		return;
+	
+	// step is rounded down, so texy stays below height on the last row
+	step = ((uint32_t)tex->height << 16) / wallheight;
+	texy = (uint32_t)(top - ceiling) * step;
+	pitch = winw;
+	pixel = framebuffer + top * pitch + x;
+	
+	first = texy >> 16;
+	last = (texy + (bottom - 1 - top) * step) >> 16;
+	if (bottom - top < last - first + 1)
+	{
+		// fewer rows than texels: shade just the ones drawn
+		for (y=top ; y<bottom ; y++, pixel += pitch, texy += step) {
+			texel = column[texy >> 16];
+			*pixel = ARGB(shade[texel >> 16 & 0xFF],
+						  shade[texel >> 8 & 0xFF],
+						  shade[texel & 0xFF]);
+		}
+		return;
+	}
+	
+	for (y=first ; y<=last ; y++) {
+		texel = column[y];
+		shaded[y] = ARGB(shade[texel >> 16 & 0xFF],
+						 shade[texel >> 8 & 0xFF],
+						 shade[texel & 0xFF]);
+	}
+	for (y=top ; y<bottom ; y++, pixel += pitch, texy += step)
+		*pixel = shaded[texy >> 16];
+}
+
+
+
+
+int CompareSprites (const void *a, const void *b)
+{
+	float da = ((const sprite_t *)a)->depth;
+	float db = ((const sprite_t *)b)->depth;
+	
+	return (da < db) - (da > db); // far to near
+}
+
+
+
+
+//
+// AddSprite
+// Project the actor at x, y, if it's in view, and add it to the sprites
+//
+void AddSprite (float x, float y, float r)
+{
+	float		relx, rely;
+	float		depth, side;
+	float		center, half;
+	float		brightness;
+	int			height;
+	sprite_t	*sprite;
+	
+	relx = x - view.x;
+	rely = y - view.y;
+	depth = relx * view.sin + rely * view.cos;
+	if (depth < SPRITE_NEAR || depth >= viewdepth)
+		return;
+	side = relx * view.cos - rely * view.sin; // to the left
+	
+	// columns are evenly spaced in angle
+	center = (fov / 2.0f - atan2f(side, depth)) / fov * winw;
+	half = atanf(r / depth) / fov * winw;
+	if (center + half <= 0 || center - half >= winw)
+		return;
+	
+	if (numsprites == maxsprites)
+	{
+		maxsprites = maxsprites ? maxsprites * 2 : 256;
+		sprites = realloc(sprites, maxsprites * sizeof(sprite_t));
+		if (!sprites)
+			Quit("AddSprite: Out of memory");
+	}
+	sprite = &sprites[numsprites];
+	
+	sprite->depth = depth;
+	sprite->left = center - half;
+	sprite->width = half * 2.0f;
+	sprite->x1 = sprite->left < 0 ? 0 : (int)ceilf(sprite->left);
+	sprite->x2 = center + half > winw ? winw : (int)ceilf(center + half);
+	if (sprite->x1 >= sprite->x2)
+		return;
+	
+	// standing on the floor, as tall as it is wide
+	height = CalcHeight(depth);
+	sprite->height = (int)(height * r * 2.0f);
+	sprite->top = halfheight + height / 2 - sprite->height;
+	if (sprite->height <= 0)
+		return;
+	
+#if SHADE
+	brightness = depth < SHADE_DIST ? 1.0f : SHADE_DIST / depth;
+#else
+	brightness = 1.0f;
+#endif
+	sprite->light = 255 * brightness * Fog(depth);
+	numsprites++;
+}
+
+
+
+
+//
+// CollectSprites
+// Find the actors in view: only grid cells in the view's dimension, within
+// the view depth and not wholly outside the field of view are looked at.
+// Call on the main thread before the strips are drawn.
+//
+void CollectSprites (void)
+{
+	int		x1, y1, x2, y2;
+	int		x, y, i;
+	float	range, relx, rely;
+	float	depth, side;
+	float	slope, margin;
+	
+	numsprites = 0;
+	if (!actors.count)
+		return;
+	
+	range = viewdepth / cosf(fov / 2.0f) + CELL_REACH;
+	x1 = view.x - range < 0 ? 0 : (int)(view.x - range);
+	y1 = view.y - range < 0 ? 0 : (int)(view.y - range);
+	x2 = view.x + range >= map.width ? map.width - 1 : (int)(view.x + range);
+	y2 = view.y + range >= map.height ? map.height - 1 : (int)(view.y + range);
+	slope = tanf(fov / 2.0f);
+	margin = CELL_REACH / cosf(fov / 2.0f);
+	
+	for (y=y1 ; y<=y2 ; y++)
+		for (x=x1 ; x<=x2 ; x++)
+		{
+			i = actorcells[ActorCell(view.w, x, y)];
+			if (i == -1)
+				continue;
+			
+			relx = x + 0.5f - view.x;
+			rely = y + 0.5f - view.y;
+			depth = relx * view.sin + rely * view.cos;
+			side = relx * view.cos - rely * view.sin;
+			if (depth < -CELL_REACH || fabsf(side) > depth * slope + margin)
+				continue;
+			
+			for ( ; i!=-1 ; i=actors.next[i])
+				AddSprite(actors.oldx[i] + (actors.x[i] - actors.oldx[i]) * actorfrac,
+						  actors.oldy[i] + (actors.y[i] - actors.oldy[i]) * actorfrac,
+						  actors.r[i]);
+		}
+	
+	qsort(sprites, numsprites, sizeof(sprite_t), CompareSprites);
+}
+
+
+
+
+//
+// DrawSprites
+// Draw the parts of this frame's sprites in columns x1 to x2-1, far to
+// near, where they are in front of the walls
+//
+void DrawSprites (int x1, int x2)
+{
+	sprite_t	*sprite;
+	uint8_t		*shade;
+	uint32_t	*column, *pixel;
+	uint32_t	texel, texy, step;
+	int			x, y, first, last;
+	int			top, bottom, texx;
+	
+	for (sprite=sprites ; sprite<sprites+numsprites ; sprite++)
+	{
+		first = sprite->x1 > x1 ? sprite->x1 : x1;
+		last = sprite->x2 < x2 ? sprite->x2 : x2;
+		if (first >= last)
+			continue;
+		
+		top = sprite->top < 0 ? 0 : sprite->top;
+		bottom = sprite->top + sprite->height > winh ? winh : sprite->top + sprite->height;
+		if (top >= bottom)
+			continue;
+		step = (SPRITE_SIZE << 16) / sprite->height;
+		shade = shadetable[sprite->light >> (8 - SHADEBITS)];
+		
+		for (x=first ; x<last ; x++)
+		{
+			if (sprite->depth >= coldepth[x])
+				continue; // behind a wall
+			
+			texx = (int)((x - sprite->left) / sprite->width * SPRITE_SIZE);
+			bound(texx, 0, SPRITE_SIZE - 1);
+			column = spritetexels + texx * SPRITE_SIZE;
+			
+			texy = (uint32_t)(top - sprite->top) * step;
+			pixel = framebuffer + top * winw + x;
+			for (y=top ; y<bottom ; y++, pixel += winw, texy += step)
+			{
+				texel = column[texy >> 16];
+				if (texel)
+					*pixel = ARGB(shade[texel >> 16 & 0xFF],
+								  shade[texel >> 8 & 0xFF],
+								  shade[texel & 0xFF]);
+			}
+		}
+	}
+}
+
+
+
+
+//
+// CastColumn
+// Cast the ray for screen column x with CastRay
+//
+bool CastColumn (int x, drawinfo_t *info)
+{
+	float dirx, diry;
+	
+	// rotate view direction by the column's angle
+	dirx = view.sin * colcos[x] + view.cos * colsin[x];
+	diry = view.cos * colcos[x] - view.sin * colsin[x];
+	
+	// start ray cast in current dimension
+	// out to where the fog ends, which is a depth rather than a distance
+	if (!CastRay(view.x, view.y, view.w, dirx, diry, viewdepth / colcos[x], info)) {
+		info->height = 0;
+		return false;
+	}
+	info->height = CalcHeight(info->dist * colcos[x]);
+	return true;
+}
+
+
+
+
+//
+// CachedColumns
+// Fill in columns x to x+count-1 from the ray cache if all of them are
+// there. Cached hits were cast from other columns, so the projected height
+// is redone for this one.
+//
+bool CachedColumns (int x, int count)
+{
+	int			i;
+	cachedray_t	*ray;
+	
+	if (!raycache)
+		return false;
+	
+	// a miss was only cast as far as the fog ends for its own column
+	for (i=0 ; i<count ; i++)
+	{
+		ray = &cachedrays[(viewslot - x - i + numslots) % numslots];
+		if (ray->stamp != cachestamp || (!ray->hit && ray->cos < colcos[x + i]))
+			return false;
+	}
+	
+	for (i=0 ; i<count ; i++)
+	{
+		ray = &cachedrays[(viewslot - x - i + numslots) % numslots];
+		columns[x + i] = ray->info;
+		columns[x + i].tiles = 0;
+		columns[x + i].height = ray->hit ? CalcHeight(ray->info.dist * colcos[x + i]) : 0;
+	}
+	return true;
+}
+
+
+
+
+//
+// CacheColumns
+// Keep the rays just cast for columns x to x+count-1
+//
+void CacheColumns (int x, int count)
+{
+	int			i;
+	cachedray_t	*ray;
+	
+	if (!raycache)
+		return;
+	
+	for (i=0 ; i<count ; i++)
+	{
+		ray = &cachedrays[(viewslot - x - i + numslots) % numslots];
+		ray->info = columns[x + i];
+		ray->hit = columns[x + i].height > 0;
+		ray->cos = colcos[x + i];
+		ray->stamp = cachestamp;
+	}
+}
+
+
+
+
+//
+// RenderColumns
+// Cast a ray for each screen column in strip number 'strip' (of numthreads),
+// fill in the floor and ceiling, and draw the wall slices. Columns go in
+// packets while a whole packet fits in the strip; the lanes of a packet
+// that reached a gate are recast one at a time. Rows that every wall in
+// the strip covers get no floor or ceiling. With -raycache, columns whose
+// rays are still cached aren't cast at all. Actor sprites go on top.
+//
+void RenderColumns (int strip)
+{
+	int			x, i, first, last;
+	int			rays, tiles;
+	int			hits, scalar;
+	int			top, bottom;	// rows all the strip's walls cover
+	drawinfo_t	*info;
+	
+	first = winw * strip / numthreads;
+	last = winw * (strip + 1) / numthreads;
+	rays = tiles = 0;
+	
+	PROFILE_BEGIN(PS_CAST, strip);
+	x = first;
+	if (packetlanes)
+	{
+		for ( ; x + packetlanes <= last ; x += packetlanes)
+		{
+			info = columns + x;
+			if (CachedColumns(x, packetlanes))
+				continue;
+			hits = CastPacket(x, info, &scalar);
+			rays += packetlanes;
+			for (i=0 ; i<packetlanes ; i++)
+			{
+				if (scalar & 1 << i)
+					CastColumn(x + i, &info[i]);
+				else if (!(hits & 1 << i))
+					info[i].height = 0;
+				tiles += info[i].tiles;
+			}
+			CacheColumns(x, packetlanes);
+		}
+	}
+	
+	for ( ; x < last; x++)
+	{
+		if (CachedColumns(x, 1))
+			continue;
+		CastColumn(x, &columns[x]);
+		rays++;
+		tiles += columns[x].tiles;
+		CacheColumns(x, 1);
+	}
+	PROFILE_END(PS_CAST, strip);
+	
+	// same span as DrawWallColumn
+	top = 0;
+	bottom = winh;
+	for (x=first ; x<last ; x++)
+	{
+		i = columns[x].height;
+		if (i <= 0) {
+			top = bottom; // ray left the map or view
+			break;
+		}
+		if (halfheight - i/2 > top)
+			top = halfheight - i/2;
+		if (halfheight + i/2 < bottom)
+			bottom = halfheight + i/2;
+	}
+	if (top >= bottom)
+		top = bottom = winh;
+	PROFILE_BEGIN(PS_BACKGROUND, strip);
+	DrawBackground(first, last, 0, top);
+	DrawBackground(first, last, bottom, winh);
+	PROFILE_END(PS_BACKGROUND, strip);
+	
+	PROFILE_BEGIN(PS_WALLS, strip);
+	for (x=first ; x<last ; x++)
+		if (columns[x].height > 0)
+			DrawWallColumn(x, &columns[x]);
+	PROFILE_END(PS_WALLS, strip);
+	
+	if (numsprites)
+	{
+		PROFILE_BEGIN(PS_SPRITES, strip);
+		for (x=first ; x<last ; x++)
+			coldepth[x] = columns[x].depth * colcos[x];
+		DrawSprites(first, last);
+		PROFILE_END(PS_SPRITES, strip);
+	}
+	
+	workers[strip].rays = rays;
+	workers[strip].tiles = tiles;
+}
+
+
+
+
+//
+// RenderWorker
+// Render thread: waits for each new frame, draws its strip, and reports back
+//
+int RenderWorker (void *data)
+{
+	worker_t	*worker = data;
+	int			frame = 0;
+	
+	while (1)
+	{
+		SDL_LockMutex(poolmutex);
+		while (framenum == frame)
+			SDL_CondWait(startcond, poolmutex);
+		frame = framenum;
+		SDL_UnlockMutex(poolmutex);
+		
+		RenderColumns(worker->index);
+		
+		SDL_LockMutex(poolmutex);
+		if (--pending == 0)
+			SDL_CondSignal(donecond);
+		SDL_UnlockMutex(poolmutex);
+	}
+	
+	return 0;
+}
+
+
+
+
+//
+// InitRenderThreads
+// Start count-1 render threads; the main thread draws the first strip
+//
+void InitRenderThreads (int count)
+{
+	int i;
+	
+	bound(count, 1, winw);
+	numthreads = count;
+	workers = calloc(numthreads, sizeof(worker_t));
+	if (!workers)
+		Quit("InitRenderThreads: Out of memory");
+	if (numthreads == 1)
+		return;
+	
+	poolmutex = SDL_CreateMutex();
+	startcond = SDL_CreateCond();
+	donecond = SDL_CreateCond();
+	if (!poolmutex || !startcond || !donecond)
+		Quit("InitRenderThreads: Could not create thread pool");
+	
+	for (i=1 ; i<numthreads ; i++)
+	{
+		workers[i].index = i;
+		workers[i].thread = SDL_CreateThread(RenderWorker, "render", &workers[i]);
+		if (!workers[i].thread)
+			Quit("InitRenderThreads: Could not create thread");
+	}
+	printf("InitRenderThreads: Rendering with %d threads\n", numthreads);
+}
+
+
+
+
+//
+// SnapViewAngle
+// For the ray cache: turn the view to the nearest multiple of the column
+// spacing, so the rays of one frame line up with the next's, and throw
+// the cache away if the view has moved or the map has changed
+//
+void SnapViewAngle (void)
+{
+	float	spacing;
+	
+	spacing = fov / winw;
+	viewslot = (int)(lroundf(view.angle / spacing) % numslots);
+	if (viewslot < 0)
+		viewslot += numslots;
+	SetAngle(&view, viewslot * spacing);
+	
+	if (view.x != cacheview.x || view.y != cacheview.y || view.w != cacheview.w
+		|| map.version != cacheversion || viewdepth != cachedepth)
+	{
+		cacheview = view;
+		cacheversion = map.version;
+		cachedepth = viewdepth;
+		if (++cachestamp == 0) { // wrapped, clear out old stamps
+			memset(cachedrays, 0, numslots * sizeof(cachedray_t));
+			cachestamp = 1;
+		}
+	}
+}
+
+
+
+
+//
+// RenderView
+// Draw the 3D view from 'camera' into the framebuffer
+//
+void RenderView (obj_t *camera)
+{
+	SDL_Color f = { 64, 64, 64 };
+	SDL_Color c = { 128, 32, 0 };
+	
+	view = *camera;
+	if (raycache)
+		SnapViewAngle();
+	
+	if (!background || viewdepth != backdepth
+		|| memcmp(&f, &backfloor, sizeof(f)) || memcmp(&c, &backceiling, sizeof(c)))
+		BuildBackground(&f, &c);
+	CollectSprites();
+	
+	if (numthreads == 1) {
+		RenderColumns(0);
+	} else {
+		// start the workers on this frame
+		SDL_LockMutex(poolmutex);
+		pending = numthreads - 1;
+		framenum++;
+		SDL_CondBroadcast(startcond);
+		SDL_UnlockMutex(poolmutex);
+		
+		RenderColumns(0);
+		
+		// wait for every strip to finish
+		SDL_LockMutex(poolmutex);
+		while (pending)
+			SDL_CondWait(donecond, poolmutex);
+		SDL_UnlockMutex(poolmutex);
+	}
+	
+	raycount = tilecount = 0;
+	for (int i=0 ; i<numthreads ; i++) {
+		raycount += workers[i].rays;
+		tilecount += workers[i].tiles;
+	}
+}
+
+
+
+
+//
+// PresentFrame
+// Upload the framebuffer and show it
+//
+void PresentFrame (void)
+{
+	PROFILE_BEGIN(PS_UPLOAD, 0);
+	SDL_UpdateTexture(frametexture, NULL, framebuffer, winw * sizeof(uint32_t));
+	SDL_RenderCopy(renderer, frametexture, NULL, NULL);
+	PROFILE_END(PS_UPLOAD, 0);
+	
+#if PROFILE
+	if (showprofile)
+		DrawProfile();
+#endif
+	
+	PROFILE_BEGIN(PS_PRESENT, 0);
+	SDL_RenderPresent(renderer);
+	PROFILE_END(PS_PRESENT, 0);
+}
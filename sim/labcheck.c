@@ -0,0 +1,428 @@
+//
+//  labcheck.c
+//  Labyrinth
+//
+//  Level checker (make labcheck): loads levels the way OpenMap does and
+//  reports problems that otherwise only show up in play. Levels are
+//  checked in parallel, and each gets one line of JSON, in the order given:
+//
+//  file, width, height, dims
+//  starts				[{dim, x, y}] every TT_PLAYERSTART; the game uses the last
+//  unmatched_gates		[{dim, x, y, type, matches}] gates with no matching gate
+//  					in another dimension (matches 0) or with several
+//  open, open_by_dim	tiles that aren't walls
+//  gates
+//  areas				pockets of open tiles connected within a dimension,
+//  largest_area		not counting gates
+//  reachable			open tiles a path reaches from the start, through gates
+//  unreachable
+//  unreachable_tiles	[{dim, x, y}] the first -list of them
+//  ok					one start, no unmatched gates, every open tile reachable
+//
+//  or file and error, the reason it can't be read or pathed. Dimensions
+//  count from 1, as in the editor. Exits with 1 if any level has a problem.
+//
+//  labcheck [map files] [-threads <n>] [-list <n>] [-o <file>]
+//
+//  With no files, checks every map*.lab in the current directory.
+//
+
+#include <glob.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+#define MAX_THREADS		256
+
+// a level's line of output as it is built
+typedef struct
+{
+	char	*text;
+	size_t	length;
+	size_t	size;
+	bool	ok;
+} report_t;
+
+int				myargc;
+char			**myargv;
+
+int				numlevels;
+char			**levels;
+report_t		*reports;
+int				listmax;			// unreachable tiles listed per level
+
+pthread_mutex_t	levelmutex = PTHREAD_MUTEX_INITIALIZER;
+int				nextlevel;			// first level no thread has taken
+
+
+
+
+int CheckParm (const char *check)
+{
+	int i;
+	
+	for (i=1 ; i<myargc ; i++)
+		if (!strcmp(check, myargv[i]))
+			return i;
+	return 0;
+}
+
+
+
+
+int IntParm (const char *check, int value)
+{
+	int i = CheckParm(check);
+	
+	return i && i < myargc-1 ? atoi(myargv[i+1]) : value;
+}
+
+
+
+
+double Seconds (void)
+{
+	struct timespec now;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+
+
+void Report (report_t *report, const char *format, ...)
+{
+	va_list	args;
+	int		length;
+	char	*text;
+	
+	va_start(args, format);
+	length = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+	
+	if (report->length + length + 1 > report->size)
+	{
+		report->size = (report->length + length + 1) * 2;
+		text = realloc(report->text, report->size);
+		if (!text)
+			Quit("Report: Out of memory");
+		report->text = text;
+	}
+	
+	va_start(args, format);
+	vsnprintf(report->text + report->length, length + 1, format, args);
+	va_end(args);
+	report->length += length;
+}
+
+
+
+
+//
+// ReportString
+// A JSON string
+//
+void ReportString (report_t *report, const char *string)
+{
+	const unsigned char *c;
+	
+	Report(report, "\"");
+	for (c=(const unsigned char *)string ; *c ; c++)
+	{
+		if (*c == '"' || *c == '\\')
+			Report(report, "\\%c", *c);
+		else if (*c < 0x20)
+			Report(report, "\\u%04x", *c);
+		else
+			Report(report, "%c", *c);
+	}
+	Report(report, "\"");
+}
+
+
+
+
+//
+// CountAreas
+// Flood fill each dimension's open tiles, without going through gates.
+// Returns how many separate areas there are and the size of the largest.
+//
+int CountAreas (int *largest)
+{
+	uint8_t		*seen;
+	int			*stack;
+	int			w, x, y, nx, ny, d, size, top, count;
+	size_t		numtiles, first, tile;
+	const int	dirs[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+	
+	numtiles = (size_t)map.numdims * map.width * map.height;
+	seen = calloc(numtiles, 1);
+	stack = malloc(numtiles * sizeof(int));
+	if (!seen || !stack)
+		Quit("CountAreas: Out of memory");
+	
+	count = 0;
+	*largest = 0;
+	for (first=0 ; first<numtiles ; first++)
+	{
+		if (seen[first] || TileType(map.tiles[first]) == TT_WALL)
+			continue;
+		
+		count++;
+		size = 0;
+		seen[first] = 1;
+		stack[0] = (int)first;
+		top = 1;
+		while (top)
+		{
+			tile = stack[--top];
+			size++;
+			x = tile % map.width;
+			y = tile / map.width % map.height;
+			w = tile / map.width / map.height;
+			for (d=0 ; d<4 ; d++)
+			{
+				nx = x + dirs[d][0];
+				ny = y + dirs[d][1];
+				if (!InMap(nx, ny))
+					continue;
+				tile = ((size_t)w * map.height + ny) * map.width + nx;
+				if (seen[tile] || TileType(map.tiles[tile]) == TT_WALL)
+					continue;
+				seen[tile] = 1;
+				stack[top++] = (int)tile;
+			}
+		}
+		*largest = size > *largest ? size : *largest;
+	}
+	
+	free(seen);
+	free(stack);
+	return count;
+}
+
+
+
+
+void FreeLevel (void)
+{
+	free(map.tiles);
+	free(map.gatelinks);
+	free(map.skip);
+	FreePathGraph(map.paths);
+	memset(&map, 0, sizeof(map));
+}
+
+
+
+
+//
+// CheckLevel
+// Load a level into this thread's map and write up what is wrong with it
+//
+void CheckLevel (const char *filename, report_t *report)
+{
+	tiletype_t	type;
+	uint8_t		*reached;
+	int			w, x, y, i;
+	int			starts, startw, startx, starty;
+	int			open, gates, unmatched, matches, reachable, listed;
+	int			areas, largest;
+	size_t		numtiles;
+	
+	memset(&map, 0, sizeof(map));
+	Report(report, "{\"file\": ");
+	ReportString(report, filename);
+	
+	// with no paths (BuildPathGraph refused the map) nothing is reachable
+	if (!ReadMapFile(filename) || !map.paths) {
+		Report(report, ", \"error\": ");
+		ReportString(report, maperror);
+		Report(report, "}\n");
+		report->ok = false;
+		FreeLevel();
+		return;
+	}
+	numtiles = (size_t)map.numdims * map.width * map.height;
+	Report(report, ", \"width\": %d, \"height\": %d, \"dims\": %d",
+		   map.width, map.height, map.numdims);
+	
+	// player starts, in the order PlayLoop looks at them
+	Report(report, ", \"starts\": [");
+	starts = 0;
+	startw = startx = starty = 0;
+	for (w=0 ; w<map.numdims ; w++)
+		for (y=0 ; y<map.height ; y++)
+			for (x=0 ; x<map.width ; x++)
+				if (MapType(w, x, y) == TT_PLAYERSTART)
+				{
+					Report(report, "%s{\"dim\": %d, \"x\": %d, \"y\": %d}",
+						   starts ? ", " : "", w+1, x, y);
+					starts++;
+					startw = w;
+					startx = x;
+					starty = y;
+				}
+	
+	// gates, as ReportGates warns about them
+	Report(report, "], \"unmatched_gates\": [");
+	gates = unmatched = 0;
+	for (w=0 ; w<map.numdims ; w++)
+		for (y=0 ; y<map.height ; y++)
+			for (x=0 ; x<map.width ; x++)
+			{
+				type = MapType(w, x, y);
+				if (type != TT_GATE_H && type != TT_GATE_V)
+					continue;
+				gates++;
+				matches = GateMatches(w, x, y);
+				if (matches == 1)
+					continue;
+				Report(report, "%s{\"dim\": %d, \"x\": %d, \"y\": %d, \"type\": \"%s\", \"matches\": %d}",
+					   unmatched ? ", " : "", w+1, x, y, type == TT_GATE_H ? "h" : "v", matches);
+				unmatched++;
+			}
+	Report(report, "]");
+	
+	// open area
+	Report(report, ", \"open_by_dim\": [");
+	open = 0;
+	for (w=0 ; w<map.numdims ; w++)
+	{
+		i = 0;
+		for (y=0 ; y<map.height ; y++)
+			for (x=0 ; x<map.width ; x++)
+				i += MapType(w, x, y) != TT_WALL;
+		Report(report, "%s%d", w ? ", " : "", i);
+		open += i;
+	}
+	areas = CountAreas(&largest);
+	Report(report, "], \"open\": %d, \"gates\": %d, \"areas\": %d, \"largest_area\": %d",
+		   open, gates, areas, largest);
+	
+	// what the player can get to from where the game starts them
+	reached = calloc(numtiles, 1);
+	if (!reached)
+		Quit("CheckLevel: Out of memory");
+	reachable = starts ? MarkReachable(startw, startx, starty, reached) : 0;
+	Report(report, ", \"reachable\": %d, \"unreachable\": %d, \"unreachable_tiles\": [",
+		   reachable, open - reachable);
+	listed = 0;
+	for (w=0 ; w<map.numdims && listed<listmax ; w++)
+		for (y=0 ; y<map.height && listed<listmax ; y++)
+			for (x=0 ; x<map.width && listed<listmax ; x++)
+				if (MapType(w, x, y) != TT_WALL
+					&& !reached[((size_t)w * map.height + y) * map.width + x])
+				{
+					Report(report, "%s{\"dim\": %d, \"x\": %d, \"y\": %d}",
+						   listed ? ", " : "", w+1, x, y);
+					listed++;
+				}
+	free(reached);
+	
+	report->ok = starts == 1 && !unmatched && reachable == open;
+	Report(report, "], \"ok\": %s}\n", report->ok ? "true" : "false");
+	
+	FreeLevel();
+}
+
+
+
+
+//
+// CheckLevels
+// Thread pool worker: check levels until there are none left
+//
+void *CheckLevels (void *data)
+{
+	int level;
+	
+	while (1)
+	{
+		pthread_mutex_lock(&levelmutex);
+		level = nextlevel++;
+		pthread_mutex_unlock(&levelmutex);
+		if (level >= numlevels)
+			break;
+		CheckLevel(levels[level], &reports[level]);
+	}
+	
+	return data;
+}
+
+
+
+
+int main (int argc, char **argv)
+{
+	pthread_t	threads[MAX_THREADS];
+	glob_t		found;
+	FILE		*out;
+	int			numthreads, i, failed;
+	double		start;
+	
+	myargc = argc;
+	myargv = argv;
+	numthreads = IntParm("-threads", (int)sysconf(_SC_NPROCESSORS_ONLN));
+	bound(numthreads, 1, MAX_THREADS);
+	listmax = IntParm("-list", 20);
+	
+	// level files are the arguments that aren't options
+	levels = malloc(argc * sizeof(char *));
+	if (!levels)
+		Quit("labcheck: Out of memory");
+	for (i=1 ; i<argc ; i++)
+	{
+		if (!strcmp(argv[i], "-threads") || !strcmp(argv[i], "-list")
+			|| !strcmp(argv[i], "-o"))
+			i++;
+		else if (argv[i][0] != '-')
+			levels[numlevels++] = argv[i];
+	}
+	memset(&found, 0, sizeof(found));
+	if (!numlevels && glob("map*.lab", 0, NULL, &found) == 0) {
+		levels = found.gl_pathv;
+		numlevels = (int)found.gl_pathc;
+	}
+	if (!numlevels)
+		Quit("labcheck: No levels to check");
+	
+	out = stdout;
+	if ((i = CheckParm("-o")) && i < argc-1 && !(out = fopen(argv[i+1], "w")))
+		Quit("labcheck: Could not open output file");
+	
+	reports = calloc(numlevels, sizeof(report_t));
+	if (!reports)
+		Quit("labcheck: Out of memory");
+	
+	start = Seconds();
+	if (numthreads > numlevels)
+		numthreads = numlevels;
+	for (i=1 ; i<numthreads ; i++)
+		if (pthread_create(&threads[i], NULL, CheckLevels, NULL)) {
+			fprintf(stderr, "labcheck: Could not create thread, using %d\n", i);
+			break;
+		}
+	numthreads = i;
+	CheckLevels(NULL);
+	for (i=1 ; i<numthreads ; i++)
+		pthread_join(threads[i], NULL);
+	
+	failed = 0;
+	for (i=0 ; i<numlevels ; i++)
+	{
+		fputs(reports[i].text, out);
+		failed += !reports[i].ok;
+		free(reports[i].text);
+	}
+	if (out != stdout)
+		fclose(out);
+	fprintf(stderr, "labcheck: %d levels, %d with problems, %d threads, %.2f s\n",
+			numlevels, failed, numthreads, Seconds() - start);
+	
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,368 @@
+//
+//  pathcheck.c
+//  Labyrinth
+//
+//  Path graph regression check (make pathcheck): builds random levels of
+//  awkward sizes, edits them tile by tile as the editor does, and checks
+//  PathReachable and FindPath against a plain search over every tile after
+//  each batch of edits. Prints each failure and exits with 1 if there are
+//  any.
+//
+//  pathcheck [-seed <n>]
+//
+
+#include "sim.h"
+
+#define CHECK_EDITS		400		// per level
+#define CHECK_EVERY		20		// edits between checks
+#define CHECK_QUERIES	40		// per check
+
+int			myargc;
+char		**myargv;
+
+uint32_t	checkseed = 1;
+int			failures;
+
+int			*reference;			// per node: -1 if the reference search hasn't
+int			*queue;				// reached it
+
+// width, height, dimensions: most not a multiple of PATH_CLUSTER
+const int	checksizes[][3] = {
+	{ 66, 8, 1 }, { 1, 1, 1 }, { 7, 3, 2 }, { 13, 21, 3 }, { 17, 9, 5 },
+	{ 64, 64, 5 }, { 41, 33, 4 }, { 9, 70, 2 },
+};
+
+
+
+
+int CheckParm (const char *check)
+{
+	int i;
+	
+	for (i=1 ; i<myargc ; i++)
+		if (!strcmp(check, myargv[i]))
+			return i;
+	return 0;
+}
+
+
+
+
+int CheckRandom (int range)
+{
+	checkseed = checkseed * 1664525 + 1013904223;
+	return (checkseed >> 8) % range;
+}
+
+
+
+
+tile_t RandomTile (void)
+{
+	int roll = CheckRandom(20);
+	
+	if (roll < 6)
+		return MakeTile(TT_WALL, 0);
+	if (roll == 6)
+		return MakeTile(TT_GATE_H, 0);
+	if (roll == 7)
+		return MakeTile(TT_GATE_V, 0);
+	return MakeTile(TT_EMPTY, 0);
+}
+
+
+
+
+void Fail (const char *what, int w, int x, int y, int goalw, int goalx, int goaly)
+{
+	printf("pathcheck: %dx%dx%d: %s from %d %d,%d to %d %d,%d\n", map.width,
+		   map.height, map.numdims, what, w, x, y, goalw, goalx, goaly);
+	failures++;
+}
+
+
+
+
+//
+// RefNode, RefNeighbors
+// The rules path.c documents, written out plainly: tiles step to their
+// four neighbors, a gate tile has a node for each side of its center line,
+// and crossing the line leads to the other side in GateDestination
+//
+int RefNode (int w, int x, int y, int side)
+{
+	return (((w * map.height + y) * map.width + x) << 1) | side;
+}
+
+
+
+
+int RefNeighbors (int w, int x, int y, int side, int *next)
+{
+	const int	dirs[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+	tiletype_t	type, ntype;
+	int			d, dx, dy, nx, ny, count;
+	bool		along;
+	
+	type = MapType(w, x, y);
+	count = 0;
+	for (d=0 ; d<4 ; d++)
+	{
+		dx = dirs[d][0];
+		dy = dirs[d][1];
+		
+		// leaving a gate along its axis: from the side facing that way
+		along = (type == TT_GATE_H && dx) || (type == TT_GATE_V && dy);
+		if (along && side != (dx + dy > 0))
+			continue;
+		
+		nx = x + dx;
+		ny = y + dy;
+		if (!InMap(nx, ny))
+			continue;
+		ntype = MapType(w, nx, ny);
+		if (ntype == TT_WALL)
+			continue;
+		
+		// entering a gate along its axis: on the near side, else either
+		along = (ntype == TT_GATE_H && dx) || (ntype == TT_GATE_V && dy);
+		if (along)
+			next[count++] = RefNode(w, nx, ny, dx + dy < 0);
+		else {
+			next[count++] = RefNode(w, nx, ny, 0);
+			if (ntype == TT_GATE_H || ntype == TT_GATE_V)
+				next[count++] = RefNode(w, nx, ny, 1);
+		}
+	}
+	if (type == TT_GATE_H || type == TT_GATE_V)
+		next[count++] = RefNode(GateDestination(w, x, y), x, y, !side);
+	return count;
+}
+
+
+
+
+//
+// RefReachable
+// Breadth first over every node from the start tile
+//
+bool RefReachable (int w, int x, int y, int goalw, int goalx, int goaly)
+{
+	int		numnodes, head, tail, node, side, count, i;
+	int		next[9];
+	int		nw, nx, ny;
+	
+	numnodes = map.numdims * map.width * map.height * 2;
+	for (i=0 ; i<numnodes ; i++)
+		reference[i] = -1;
+	
+	head = tail = 0;
+	for (side=0 ; side<2 ; side++)
+	{
+		if (side && MapType(w, x, y) != TT_GATE_H && MapType(w, x, y) != TT_GATE_V)
+			continue;
+		reference[RefNode(w, x, y, side)] = 1;
+		queue[tail++] = RefNode(w, x, y, side);
+	}
+	
+	while (head < tail)
+	{
+		node = queue[head++];
+		nx = (node >> 1) % map.width;
+		ny = (node >> 1) / map.width % map.height;
+		nw = (node >> 1) / map.width / map.height;
+		if (nw == goalw && nx == goalx && ny == goaly)
+			return true;
+		count = RefNeighbors(nw, nx, ny, node & 1, next);
+		for (i=0 ; i<count ; i++)
+			if (reference[next[i]] == -1) {
+				reference[next[i]] = 1;
+				queue[tail++] = next[i];
+			}
+	}
+	return false;
+}
+
+
+
+
+//
+// CheckPath
+// A path from FindPath must start and end at the query's tiles, step
+// between open neighbors, and only change dimension where a gate leads
+//
+bool CheckPath (pathstep_t *path, int length, int w, int x, int y,
+				int goalw, int goalx, int goaly)
+{
+	pathstep_t	*a, *b;
+	tiletype_t	type;
+	int			i, steps;
+	
+	if (path[0].w != w || path[0].x != x || path[0].y != y)
+		return false;
+	if (path[length-1].w != goalw || path[length-1].x != goalx || path[length-1].y != goaly)
+		return false;
+	
+	for (i=1 ; i<length ; i++)
+	{
+		a = &path[i-1];
+		b = &path[i];
+		if (MapType(b->w, b->x, b->y) == TT_WALL)
+			return false;
+		steps = abs(b->x - a->x) + abs(b->y - a->y);
+		if (steps == 1 && b->w == a->w)
+			continue;
+		type = MapType(a->w, a->x, a->y);
+		if (steps || (type != TT_GATE_H && type != TT_GATE_V)
+			|| GateDestination(a->w, a->x, a->y) != b->w)
+			return false;
+	}
+	return true;
+}
+
+
+
+
+//
+// RandomOpenTile
+// Returns false if a level is all walls after its edits
+//
+bool RandomOpenTile (int *w, int *x, int *y)
+{
+	int tries;
+	
+	for (tries=0 ; tries<1000 ; tries++)
+	{
+		*w = CheckRandom(map.numdims);
+		*x = CheckRandom(map.width);
+		*y = CheckRandom(map.height);
+		if (MapType(*w, *x, *y) != TT_WALL)
+			return true;
+	}
+	return false;
+}
+
+
+
+
+void CheckQueries (pathstep_t *path, int maxsteps)
+{
+	int		w, x, y, goalw, goalx, goaly, q;
+	int		length;
+	bool	reachable;
+	
+	for (q=0 ; q<CHECK_QUERIES ; q++)
+	{
+		if (!RandomOpenTile(&w, &x, &y) || !RandomOpenTile(&goalw, &goalx, &goaly))
+			return;
+		reachable = RefReachable(w, x, y, goalw, goalx, goaly);
+		if (PathReachable(w, x, y, goalw, goalx, goaly) != reachable)
+			Fail("PathReachable disagrees", w, x, y, goalw, goalx, goaly);
+		
+		length = FindPath(w, x, y, goalw, goalx, goaly, path, maxsteps);
+		if ((length != -1) != reachable)
+			Fail("FindPath disagrees", w, x, y, goalw, goalx, goaly);
+		else if (length > maxsteps)
+			Fail("FindPath path too long", w, x, y, goalw, goalx, goaly);
+		else if (length != -1 && !CheckPath(path, length, w, x, y, goalw, goalx, goaly))
+			Fail("FindPath bad path", w, x, y, goalw, goalx, goaly);
+	}
+}
+
+
+
+
+//
+// CheckLevel
+// A random level of the given size, checked as it is edited
+//
+void CheckLevel (int width, int height, int numdims)
+{
+	pathstep_t	*path;
+	int			maxsteps, w, x, y, edit;
+	
+	if (!AllocMap(width, height, numdims))
+		Quit("pathcheck: Could not allocate map");
+	for (w=0 ; w<numdims ; w++)
+		for (y=0 ; y<height ; y++)
+			for (x=0 ; x<width ; x++)
+				SetMapTile(w, x, y, RandomTile());
+	SetMapTile(0, 0, 0, MakeTile(TT_EMPTY, 0)); // somewhere open to start
+	BuildMapTables();
+	
+	maxsteps = numdims * width * height * 2;
+	path = malloc(maxsteps * sizeof(pathstep_t));
+	reference = malloc(maxsteps * sizeof(int));
+	queue = malloc(maxsteps * sizeof(int));
+	if (!path || !reference || !queue)
+		Quit("pathcheck: Out of memory");
+	
+	CheckQueries(path, maxsteps);
+	for (edit=0 ; edit<CHECK_EDITS ; edit++)
+	{
+		w = CheckRandom(numdims);
+		x = CheckRandom(width);
+		y = CheckRandom(height);
+		SetMapTile(w, x, y, RandomTile());
+		UpdateMapTables(w, x, y);
+		if (edit % CHECK_EVERY == CHECK_EVERY - 1)
+			CheckQueries(path, maxsteps);
+	}
+	
+	free(path);
+	free(reference);
+	free(queue);
+}
+
+
+
+
+//
+// CheckNarrowEdge
+// An edit beside a narrow last cluster must relink it: a 66 wide map has
+// a two tile wide cluster at x 64, and walls at x 57, 59 and 61
+//
+void CheckNarrowEdge (void)
+{
+	pathstep_t	path[256];
+	int			x, y;
+	
+	if (!AllocMap(66, 8, 1))
+		Quit("pathcheck: Could not allocate map");
+	for (x=57 ; x<=61 ; x+=2)
+		for (y=0 ; y<8 ; y++)
+			SetMapTile(0, x, y, MakeTile(TT_WALL, 0));
+	BuildMapTables();
+	
+	SetMapTile(0, 59, 0, MakeTile(TT_EMPTY, 0));
+	UpdateMapTables(0, 59, 0);
+	if (FindPath(0, 65, 0, 0, 58, 0, path, 256) != -1)
+		Fail("narrow cluster: path through a wall", 0, 65, 0, 0, 58, 0);
+	
+	SetMapTile(0, 59, 0, MakeTile(TT_WALL, 0));
+	UpdateMapTables(0, 59, 0);
+	if (FindPath(0, 65, 0, 0, 60, 0, path, 256) != -1)
+		Fail("narrow cluster: path through a wall", 0, 65, 0, 0, 60, 0);
+	if (FindPath(0, 65, 0, 0, 62, 7, path, 256) == -1)
+		Fail("narrow cluster: no path", 0, 65, 0, 0, 62, 7);
+}
+
+
+
+
+int main (int argc, char **argv)
+{
+	int i, level;
+	
+	myargc = argc;
+	myargv = argv;
+	if ((i = CheckParm("-seed")) && i < argc-1)
+		checkseed = atoi(argv[i+1]);
+	
+	CheckNarrowEdge();
+	for (level=0 ; level<(int)(sizeof(checksizes) / sizeof(checksizes[0])) ; level++)
+		CheckLevel(checksizes[level][0], checksizes[level][1], checksizes[level][2]);
+	
+	printf("pathcheck: %d failures\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,394 @@
+//
+//  sim.c
+//  Labyrinth
+//
+//  Headless simulation library, see sim.h. Built with NOSDL and linked
+//  with object.c, raycast.c, mapfile.c, actor.c and path.c instead of the
+//  game, so the globals the game defines in labyrinth.c are defined here.
+//
+
+#include <pthread.h>
+
+#include "sim.h"
+
+_Thread_local map_t	map;	// the world being worked on by this thread
+obj_t			player;		// unused: agents are moved as the player would be
+
+// batch step thread pool: each thread steps its own share of the agents
+typedef struct
+{
+	pthread_t	thread;
+	int			index;
+} simworker_t;
+
+int				simthreads = 1;	// including the calling thread
+simworker_t		simworkers[SIM_MAXTHREADS];
+pthread_mutex_t	simmutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t	simstart = PTHREAD_COND_INITIALIZER;	// a batch is ready
+pthread_cond_t	simdone = PTHREAD_COND_INITIALIZER;		// last share is done
+int				simbatch;		// incremented to start the workers on a batch
+int				simpending;		// shares still being stepped
+
+// the batch being stepped
+simworld_t			*batchworld;
+const simaction_t	*batchactions;
+simobs_t			*batchobs;
+
+
+
+
+void Quit (const char *error)
+{
+	if (error && *error) {
+		fprintf(stderr, "Fatal Error! %s\n", error);
+		exit(1);
+	}
+	exit(0);
+}
+
+
+
+
+//
+// SimOpenWorld
+// Load a level the same way OpenMap does. Returns NULL if it can't be
+// read.
+//
+simworld_t *SimOpenWorld (const char *filename)
+{
+	simworld_t	*world;
+	map_t		current;
+	int			w, x, y;
+	bool		loaded;
+	
+	world = calloc(1, sizeof(simworld_t));
+	if (!world) {
+		fprintf(stderr, "SimOpenWorld: Out of memory\n");
+		return NULL;
+	}
+	
+	// read into a fresh map, leaving any other world's alone
+	current = map;
+	memset(&map, 0, sizeof(map));
+	loaded = ReadMapFile(filename);
+	world->map = map;
+	map = current;
+	if (!loaded) {
+		SimCloseWorld(world);
+		return NULL;
+	}
+	
+	// agents start where the player would, the last start found
+	map = world->map;
+	world->startx = world->starty = 0.5f;
+	for (w=0 ; w<map.numdims ; w++)
+		for (y=0 ; y<map.height ; y++)
+			for (x=0 ; x<map.width ; x++)
+				if (MapType(w, x, y) == TT_PLAYERSTART) {
+					world->startw = w;
+					world->startx = x + 0.5f;
+					world->starty = y + 0.5f;
+				}
+	map = current;
+	
+	return world;
+}
+
+
+
+
+void SimCloseWorld (simworld_t *world)
+{
+	if (!world)
+		return;
+	if (map.tiles == world->map.tiles)
+		memset(&map, 0, sizeof(map));
+	free(world->map.tiles);
+	free(world->map.gatelinks);
+	free(world->map.skip);
+	FreePathGraph(world->map.paths);
+	free(world->agents);
+	free(world->depthsin);
+	free(world->depthcos);
+	free(world->depth);
+	free(world);
+}
+
+
+
+
+//
+// SimSetDepth
+// Give each observation 'width' columns of depth over the same field of
+// view as the 3D view, out to 'range' tiles. 0 turns depth off.
+//
+bool SimSetDepth (simworld_t *world, int width, float range)
+{
+	int		x;
+	float	fov, angle;
+	float	*depth;
+	
+	free(world->depthsin);
+	free(world->depthcos);
+	world->depthsin = world->depthcos = NULL;
+	world->depthwidth = 0;
+	if (width <= 0)
+		return true;
+	
+	world->depthsin = malloc(width * sizeof(float));
+	world->depthcos = malloc(width * sizeof(float));
+	depth = realloc(world->depth, (size_t)world->maxagents * width * sizeof(float) + 1);
+	if (!world->depthsin || !world->depthcos || !depth) {
+		fprintf(stderr, "SimSetDepth: Out of memory\n");
+		return false;
+	}
+	world->depth = depth;
+	
+	fov = ANG90 / 2; // as render.c
+	for (x=0 ; x<width ; x++)
+	{
+		angle = fov/2.0f - (x + 0.5f)/width*fov;
+		world->depthsin[x] = sinf(angle);
+		world->depthcos[x] = cosf(angle);
+	}
+	world->depthwidth = width;
+	world->depthrange = range > 0 ? range : INFINITY;
+	return true;
+}
+
+
+
+
+//
+// SimAddAgent
+// Add an agent at the player start. Returns its number, or -1 if out of
+// memory.
+//
+int SimAddAgent (simworld_t *world)
+{
+	int		capacity;
+	obj_t	*agents;
+	float	*depth;
+	
+	if (world->numagents == world->maxagents)
+	{
+		capacity = world->maxagents ? world->maxagents * 2 : 64;
+		agents = realloc(world->agents, capacity * sizeof(obj_t));
+		if (agents)
+			world->agents = agents;
+		depth = realloc(world->depth, (size_t)capacity * world->depthwidth * sizeof(float) + 1);
+		if (depth)
+			world->depth = depth;
+		if (!agents || !depth) {
+			fprintf(stderr, "SimAddAgent: Out of memory\n");
+			return -1;
+		}
+		world->maxagents = capacity;
+	}
+	
+	SimResetAgent(world, world->numagents);
+	return world->numagents++;
+}
+
+
+
+
+//
+// SimResetAgent
+// Put an agent back at the player start, stopped and facing as the player
+// does at the start of a level
+//
+void SimResetAgent (simworld_t *world, int agent)
+{
+	obj_t *obj = &world->agents[agent];
+	
+	memset(obj, 0, sizeof(*obj));
+	obj->type = OT_PLAYER;
+	obj->w = world->startw;
+	obj->x = obj->oldx = world->startx;
+	obj->y = obj->oldy = world->starty;
+	obj->r = PL_RADIUS;
+	SetAngle(obj, M_PI/2);
+}
+
+
+
+
+//
+// StepAgent
+// Move an agent one tick and fill in what it sees. The world's map must
+// be the current one.
+//
+void StepAgent (simworld_t *world, int agent, const simaction_t *action, simobs_t *obs)
+{
+	obj_t		*obj = &world->agents[agent];
+	float		*depth;
+	float		dirx, diry, ask, got;
+	int			x;
+	drawinfo_t	info;
+	
+	SetAngle(obj, obj->angle + PL_TURN * fmaxf(-1.0f, fminf(1.0f, action->turn)));
+	obj->dy = -PL_MOVE_SPD * fmaxf(-1.0f, fminf(1.0f, action->forward));
+	obj->dx = PL_STRAFE_SPD * fmaxf(-1.0f, fminf(1.0f, action->strafe));
+	ControlMovement(obj);
+	
+	obs->x = obj->x;
+	obs->y = obj->y;
+	obs->angle = obj->angle;
+	obs->w = obj->w;
+	obs->tile = MapType(obj->w, (int)obj->x, (int)obj->y);
+	ask = obj->dx*obj->dx + obj->dy*obj->dy;
+	got = (obj->x - obj->oldx) * (obj->x - obj->oldx)
+		+ (obj->y - obj->oldy) * (obj->y - obj->oldy);
+	obs->blocked = got < ask * 0.99f;
+	obs->depth = NULL;
+	
+	if (!world->depthwidth)
+		return;
+	
+	depth = world->depth + (size_t)agent * world->depthwidth;
+	for (x=0 ; x<world->depthwidth ; x++)
+	{
+		dirx = obj->sin * world->depthcos[x] + obj->cos * world->depthsin[x];
+		diry = obj->cos * world->depthcos[x] - obj->sin * world->depthsin[x];
+		if (CastRay(obj->x, obj->y, obj->w, dirx, diry, world->depthrange, &info))
+			depth[x] = info.dist * world->depthcos[x];
+		else
+			depth[x] = world->depthrange;
+	}
+	obs->depth = depth;
+}
+
+
+
+
+void SimStep (simworld_t *world, int agent, const simaction_t *action, simobs_t *obs)
+{
+	map = world->map;
+	StepAgent(world, agent, action, obs);
+}
+
+
+
+
+//
+// StepShare
+// Step share number 'index' (of simthreads) of the batch's agents
+//
+void StepShare (int index)
+{
+	int first, last, i;
+	
+	map = batchworld->map;
+	first = (int)((long long)batchworld->numagents * index / simthreads);
+	last = (int)((long long)batchworld->numagents * (index + 1) / simthreads);
+	for (i=first ; i<last ; i++)
+		StepAgent(batchworld, i, &batchactions[i], &batchobs[i]);
+}
+
+
+
+
+//
+// SimWorker
+// Batch thread: waits for each new batch, steps its share, and reports
+// back
+//
+void *SimWorker (void *data)
+{
+	simworker_t	*worker = data;
+	int			batch = 0;
+	
+	while (1)
+	{
+		pthread_mutex_lock(&simmutex);
+		while (simbatch == batch)
+			pthread_cond_wait(&simstart, &simmutex);
+		batch = simbatch;
+		pthread_mutex_unlock(&simmutex);
+		
+		StepShare(worker->index);
+		
+		pthread_mutex_lock(&simmutex);
+		if (--simpending == 0)
+			pthread_cond_signal(&simdone);
+		pthread_mutex_unlock(&simmutex);
+	}
+	
+	return NULL;
+}
+
+
+
+
+//
+// SimStartThreads
+// Start count-1 batch threads; the calling thread steps the first share.
+// Call once, before the first SimStepBatch.
+//
+void SimStartThreads (int count)
+{
+	int i;
+	
+	bound(count, 1, SIM_MAXTHREADS);
+	for (i=1 ; i<count ; i++)
+	{
+		simworkers[i].index = i;
+		if (pthread_create(&simworkers[i].thread, NULL, SimWorker, &simworkers[i])) {
+			fprintf(stderr, "SimStartThreads: Could not create thread, using %d\n", i);
+			break;
+		}
+	}
+	simthreads = i;
+}
+
+
+
+
+//
+// SimStepBatch
+// Step every agent in the world one tick: agent i takes actions[i], and
+// what it sees goes in obs[i]. Agents don't collide with each other, so
+// they are stepped in parallel.
+//
+void SimStepBatch (simworld_t *world, const simaction_t *actions, simobs_t *obs)
+{
+	map = world->map;
+	batchworld = world;
+	batchactions = actions;
+	batchobs = obs;
+	
+	if (simthreads == 1) {
+		StepShare(0);
+		return;
+	}
+	
+	// start the workers on this batch
+	pthread_mutex_lock(&simmutex);
+	simpending = simthreads - 1;
+	simbatch++;
+	pthread_cond_broadcast(&simstart);
+	pthread_mutex_unlock(&simmutex);
+	
+	StepShare(0);
+	
+	// wait for every share to finish
+	pthread_mutex_lock(&simmutex);
+	while (simpending)
+		pthread_cond_wait(&simdone, &simmutex);
+	pthread_mutex_unlock(&simmutex);
+}
+
+
+
+
+//
+// SimFindPath
+// FindPath in a world's level, for agents that navigate by waypoints
+//
+int SimFindPath (simworld_t *world, int w, int x, int y, int goalw, int goalx, int goaly,
+				 pathstep_t *path, int maxsteps)
+{
+	map = world->map;
+	return FindPath(w, x, y, goalw, goalx, goaly, path, maxsteps);
+}
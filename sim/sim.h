@@ -0,0 +1,72 @@
+//
+//  sim.h
+//  Labyrinth
+//
+//  Headless simulation library: agents move through a level by the same
+//  rules as the player, without SDL, a window or the renderer. Build with
+//  make libsim (or make simbench for a throughput test).
+//
+//  A world is a level loaded from a map file. Agents are numbered from 0
+//  in the order they are added. Each step takes an action and returns an
+//  observation. The game logic works on the current map, which each call
+//  points at its world. Each thread has its own current map, but batches
+//  are stepped one at a time.
+//
+
+#ifndef sim_h
+#define sim_h
+
+#include "../labyrinth.h"
+
+#define SIM_MAXTHREADS		256
+
+// what an agent does for one tick, each -1..1 of the player's top speed
+typedef struct
+{
+	float	forward;	// negative backs up
+	float	strafe;		// negative is left
+	float	turn;		// negative is right
+} simaction_t;
+
+// what an agent sees after a tick
+typedef struct
+{
+	float		x, y;		// position in tiles
+	float		angle;
+	int			w;			// dimension
+	tiletype_t	tile;		// tile type under the agent
+	bool		blocked;	// something stopped part of the move
+	const float	*depth;		// SimSetDepth columns across the view, left to
+							// right: distance to the wall in front, or the
+							// depth range if none. NULL if not set.
+} simobs_t;
+
+typedef struct
+{
+	map_t		map;
+	int			startw;		// player start, agents are placed there
+	float		startx, starty;
+	
+	int			numagents;
+	int			maxagents;
+	obj_t		*agents;
+	
+	int			depthwidth;	// columns of depth per observation, 0 for none
+	float		depthrange;
+	float		*depthsin;	// per column, as the 3D view's colsin, colcos
+	float		*depthcos;
+	float		*depth;		// numagents * depthwidth
+} simworld_t;
+
+simworld_t *SimOpenWorld (const char *filename);
+void SimCloseWorld (simworld_t *world);
+bool SimSetDepth (simworld_t *world, int width, float range);
+int SimAddAgent (simworld_t *world);
+void SimResetAgent (simworld_t *world, int agent);
+void SimStep (simworld_t *world, int agent, const simaction_t *action, simobs_t *obs);
+void SimStartThreads (int count);
+void SimStepBatch (simworld_t *world, const simaction_t *actions, simobs_t *obs);
+int SimFindPath (simworld_t *world, int w, int x, int y, int goalw, int goalx, int goaly,
+				 pathstep_t *path, int maxsteps);
+
+#endif /* sim_h */
@@ -0,0 +1,130 @@
+//
+//  simbench.c
+//  Labyrinth
+//
+//  Simulation library throughput test (make simbench): steps a crowd of
+//  agents taking random actions through a level and reports agent steps
+//  per second.
+//
+//  simbench [map file] [-agents <n>] [-steps <n>] [-threads <n>]
+//           [-depth <columns>]
+//
+
+#include <time.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+int		myargc;
+char	**myargv;
+
+
+
+
+int CheckParm (const char *check)
+{
+	int i;
+	
+	for (i=1 ; i<myargc ; i++)
+		if (!strcmp(check, myargv[i]))
+			return i;
+	return 0;
+}
+
+
+
+
+int IntParm (const char *check, int value)
+{
+	int i = CheckParm(check);
+	
+	return i && i < myargc-1 ? atoi(myargv[i+1]) : value;
+}
+
+
+
+
+double Seconds (void)
+{
+	struct timespec now;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+
+
+int main (int argc, char **argv)
+{
+	simworld_t	*world;
+	simaction_t	*actions;
+	simobs_t	*obs;
+	const char	*filename;
+	int			numagents, numsteps, numthreads, depth;
+	int			i, step, blocked, dims;
+	uint32_t	seed;
+	double		start, elapsed;
+	
+	myargc = argc;
+	myargv = argv;
+	filename = argc > 1 && argv[1][0] != '-' ? argv[1] : "map01.lab";
+	numagents = IntParm("-agents", 10000);
+	numsteps = IntParm("-steps", 600);
+	numthreads = IntParm("-threads", (int)sysconf(_SC_NPROCESSORS_ONLN));
+	depth = IntParm("-depth", 0);
+	
+	world = SimOpenWorld(filename);
+	if (!world)
+		Quit("simbench: Could not open map");
+	for (i=0 ; i<numagents ; i++)
+		if (SimAddAgent(world) == -1)
+			Quit("simbench: Could not add agents");
+	if (!SimSetDepth(world, depth, 16.0f))
+		Quit("simbench: Could not set depth");
+	actions = malloc(numagents * sizeof(simaction_t));
+	obs = malloc(numagents * sizeof(simobs_t));
+	if (!actions || !obs)
+		Quit("simbench: Out of memory");
+	SimStartThreads(numthreads);
+	
+	printf("simbench: %s %dx%dx%d agents %d steps %d threads %d depth %d\n",
+		   filename, world->map.width, world->map.height, world->map.numdims,
+		   numagents, numsteps, numthreads, depth);
+	
+	seed = 1;
+	blocked = 0;
+	elapsed = 0;
+	for (step=0 ; step<numsteps ; step++)
+	{
+		// each agent holds a random action for a while
+		if (step % 30 == 0)
+			for (i=0 ; i<numagents ; i++)
+			{
+				seed = seed * 1664525 + 1013904223;
+				actions[i].forward = (seed >> 24) / 127.5f - 1.0f;
+				actions[i].strafe = (seed >> 16 & 0xFF) / 127.5f - 1.0f;
+				actions[i].turn = (seed >> 8 & 0xFF) / 127.5f - 1.0f;
+			}
+		
+		start = Seconds();
+		SimStepBatch(world, actions, obs);
+		elapsed += Seconds() - start;
+		
+		for (i=0 ; i<numagents ; i++)
+			blocked += obs[i].blocked;
+	}
+	
+	dims = 0;
+	for (i=0 ; i<numagents ; i++)
+		dims += obs[i].w != world->startw;
+	printf("simbench: %.3f s, %.2f million agent steps/s\n", elapsed,
+		   (double)numagents * numsteps / elapsed / 1e6);
+	printf("simbench: %.1f%% of steps blocked, %d agents ended in another dimension\n",
+		   100.0 * blocked / ((double)numagents * numsteps), dims);
+	
+	SimCloseWorld(world);
+	free(actions);
+	free(obs);
+	return 0;
+}